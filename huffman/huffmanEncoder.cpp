@@ -116,16 +116,14 @@ std::vector<uint8_t> HuffmanEncoder::Encode(uint8_t *const buffer, uint32_t buff
 
         curNode->weight = leftNode->weight + rightNode->weight;
 
-        if (nodeDueqe.size() > 1)
-        {
-            if (curNode->weight > (nodeDueqe[nodeDueqe.size() - 1]->weight + nodeDueqe[nodeDueqe.size() - 2]->weight))
-            {
-                nodeDueqe.insert(nodeDueqe.end() - 3, curNode);
-                continue;
-            }
-        }
-
-        nodeDueqe.emplace_back(curNode);
+        // 按权重从大到小插入，保证末尾总是权重最小的两个节点
+        auto pos = std::upper_bound(nodeDueqe.begin(), nodeDueqe.end(), curNode,
+                                    [](const std::shared_ptr<HuffmanNode> &sun, const std::shared_ptr<HuffmanNode> &moon)
+                                    {
+                                        return sun->weight > moon->weight;
+                                    });
+
+        nodeDueqe.insert(pos, curNode);
     }
 
     this->_root = curNode;
@@ -150,7 +148,8 @@ std::vector<uint8_t> HuffmanEncoder::Encode(uint8_t *const buffer, uint32_t buff
         for(const auto& val : node->path) this->SetBits(encodedBuffer,1,val);
     }
 
-    if(this->_bitCount) encodedBuffer.emplace_back(this->_curValue);
+    // 最后一个字节写满时_bitCount为0，同样需要写入
+    if(this->_bitCount < 8) encodedBuffer.emplace_back(this->_curValue);
 
     return encodedBuffer;
 }
\ No newline at end of file
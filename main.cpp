@@ -1,9 +1,13 @@
 #include <cstdio>
+#include <cstdlib>
 #include <string>
+#include <vector>
+#include <cctype>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <windows.h>
 #include "packFunc/packFunc.h"
+#include "packFunc/hash.hpp"
 
 bool IsDirectoryPath(const std::string& path)
 {
@@ -27,18 +31,129 @@ inline int GetCodePage(const char* const codePage)
     return CP_ACP;
 }
 
+inline bool IsCodePageName(const char* const name)
+{
+    return stricmp(name, "CP_ACP") == 0 || stricmp(name, "CP_UTF8") == 0;
+}
+
+IoMode GetIoMode(const char* const name)
+{
+    if (stricmp(name, "async") == 0)
+        return IoMode::Async;
+    return IoMode::Sync;
+}
+
+ListFormat GetListFormat(const char* const name)
+{
+    if (stricmp(name, "csv") == 0)
+        return ListFormat::Csv;
+    else if (stricmp(name, "json") == 0)
+        return ListFormat::Json;
+    return ListFormat::Text;
+}
+
+inline bool IsListFormatName(const char* const name)
+{
+    return stricmp(name, "text") == 0 || stricmp(name, "csv") == 0 || stricmp(name, "json") == 0;
+}
+
+/**
+ * @brief 解析以MB为单位的size参数
+ *
+ * @param value 参数字符串
+ * @param maxSize 允许的最大值，单位MB
+ * @param[out] size 转换成字节的size
+ * @return 不是数字、为0或者超过maxSize时返回false
+ */
+bool GetSizeMB(const char* const value, uint64_t maxSize, uint64_t &size)
+{
+    if (!isdigit((unsigned char)value[0])) return false;
+
+    char *end = nullptr;
+    uint64_t megabytes = strtoull(value, &end, 10);
+
+    if (*end != '\0' || megabytes == 0 || megabytes > maxSize) return false;
+
+    size = megabytes << 20;
+    return true;
+}
+
+/**
+ * @brief 解析逗号分隔的扩展名列表，转换成小写并补上'.'
+ */
+std::vector<std::string> GetExtensionList(const char* const list)
+{
+    std::vector<std::string> extensions;
+    std::string extension;
+
+    for (const char* p = list;; p++)
+    {
+        if (*p == ',' || *p == '\0')
+        {
+            if (!extension.empty())
+            {
+                if (extension[0] != '.') extension.insert(extension.begin(), '.');
+                extensions.emplace_back(extension);
+                extension.clear();
+            }
+
+            if (*p == '\0') break;
+        }
+        else
+        {
+            extension += (char)tolower((unsigned char)*p);
+        }
+    }
+
+    return extensions;
+}
+
 int main(int argc, char** argv)
 {
-    if (argc < 4)
+    if (argc < 3)
     {
         printf("NeXAS Pack Tool\n");
         printf("Usage:\n");
-        printf("  Create Package  : Tool -c <no|zlib|zstd> <package.pac> <path/to/folder> [CP_ACP|CP_UTF8]\n");
-        printf("  Extract Package : Tool -x <package.pac> <path/to/folder> [CP_ACP|CP_UTF8]\n");
+        printf("  Create Package  : Tool -c <no|zlib|zstd> <package.pac> <path/to/folder|@list.txt> [CP_ACP|CP_UTF8] [options]\n");
+        printf("    @list.txt         Pack files listed in a manifest in its order, one 'path[\\tname[\\tmethod[\\tlevel]]]' per line\n");
+        printf("    --base <old.pac>  Reuse compressed data of unchanged files from old.pac\n");
+        printf("    --base-hash       Compare content hashes even if modify times match\n");
+        printf("    --sum             Write <package.pac>.sum for later incremental packing\n");
+        printf("    --dedup           Store identical files once and point their entries at the same data\n");
+        printf("    --store-entropy <bits> Store files whose sampled entropy is at least this, default 7.9\n");
+        printf("    --store-ratio <ratio>  Store files whose trial compression ratio is at least this, default 0.97\n");
+        printf("    --store-ext <.a,.b>    Always store files with these extensions\n");
+        printf("    --layout <trace>  Write entries listed in an access trace first in trace order, group the rest by extension\n");
+        printf("    --align <N>       Pad so that every payload starts at a multiple of N bytes, a power of two up to 1048576, e.g. 4096\n");
+        printf("    --volume-size <MB> Split into <name>.1.pac, <name>.2.pac... above this size, default and maximum 4096\n");
+        printf("    --unordered       Let each thread write its data as soon as it is compressed, data order is not fixed\n");
+        printf("    --sort-index      Sort the index by entry name\n");
+        printf("    --idx             Write <package.pac>.idx so that opening the package maps the decoded index\n");
+        printf("    --level <N>       Compression level for files without one in the manifest, default is the maximum\n");
+        printf("    --stream-size <MB> Compress files of at least this size in chunks without loading them, default 256\n");
+        printf("    --io <sync|async> Write the package with overlapped I/O while compressing, default sync\n");
+        printf("    --cache <dir>     Share compressed data between runs through a cache directory\n");
+        printf("    --cache-size <MB> Size limit of the cache directory, default 4096\n");
+        printf("  Transcode       : Tool -r <no|zlib|zstd> <source.pac> <package.pac> [options], keep names, order and volumes\n");
+        printf("    --level <N> --sum --idx --io <sync|async> as for -c, the output can be the source package\n");
+        printf("  Extract Package : Tool -x <package.pac> <path/to/folder> [CP_ACP|CP_UTF8] [options]\n");
+        printf("    --io <sync|async> Read entries through an I/O completion port while decompressing, default sync\n");
+        printf("    --skip-unchanged  Do not rewrite files that already exist with the same content\n");
+        printf("  List Package    : Tool -l <package.pac> [text|csv|json] [CP_ACP|CP_UTF8]\n");
+        printf("  Verify Package  : Tool -t <package.pac> [--io <sync|async>]\n");
+        printf("  Index Cache     : Tool -i <package.pac>, write <package.pac>.idx for an existing package\n");
+        printf("  Benchmark       : Tool -b <package.pac> [runs], verify with sync and async reads from a cold cache\n");
         printf("  Default CodePage is CP_ACP\n");
         return 1;
     }
 
+    // .sum、去重和增量打包都依赖XXH64的结果和xxHash一致
+    if (!XXHash64::SelfTest())
+    {
+        printf("ERROR: XXH64 self-test failed.");
+        return 1;
+    }
+
     // Replaces with std::string_view in C++17
     std::string cmd(argv[1]);
 
@@ -55,7 +170,8 @@ int main(int argc, char** argv)
         std::string pacPath(argv[3]);
         std::string dirPath(argv[4]);
 
-        if (!IsDirectoryPath(dirPath))
+        // @开头的是清单文件
+        if (dirPath[0] != '@' && !IsDirectoryPath(dirPath))
         {
             printf("ERROR: Path is not a directory.");
             return 1;
@@ -63,18 +179,217 @@ int main(int argc, char** argv)
 
         int compressionMethod = GetCompressionMethod(argv[2]);
 
-        if(argc>=6) codePage =  GetCodePage(argv[5]);
+        PackOptions options;
 
-        CreatePackageMT(pacPath, dirPath, compressionMethod,codePage);
+        for (int i = 5; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+
+            if (arg == "--base" && i + 1 < argc)
+                options.BasePath = argv[++i];
+            else if (arg == "--base-hash")
+                options.BaseHash = true;
+            else if (arg == "--sum")
+                options.WriteChecksum = true;
+            else if (arg == "--dedup")
+                options.Dedup = true;
+            else if (arg == "--store-entropy" && i + 1 < argc)
+                options.StoreEntropy = atof(argv[++i]);
+            else if (arg == "--store-ratio" && i + 1 < argc)
+                options.StoreRatio = atof(argv[++i]);
+            else if (arg == "--store-ext" && i + 1 < argc)
+                options.StoreExtensions = GetExtensionList(argv[++i]);
+            else if (arg == "--layout" && i + 1 < argc)
+                options.LayoutPath = argv[++i];
+            else if (arg == "--align" && i + 1 < argc)
+            {
+                char *end = nullptr;
+                uint64_t align = strtoull(argv[++i], &end, 10);
+
+                // 填充用的缓冲区是Align - 1字节，限制在1MB以内
+                if (!isdigit((unsigned char)argv[i][0]) || *end != '\0' || align == 0 || align > (1 << 20) || (align & (align - 1)) != 0)
+                {
+                    printf("ERROR: Invalid alignment '%s', expected a power of two up to 1048576.", argv[i]);
+                    return 1;
+                }
+
+                options.Align = (uint32_t)align;
+            }
+            else if (arg == "--volume-size" && i + 1 < argc)
+            {
+                // 最小1MB，放得下文件头和一个文件的索引
+                if (!GetSizeMB(argv[++i], 4096, options.VolumeSize))
+                {
+                    printf("ERROR: Invalid volume size '%s', expected 1 to 4096 MB.", argv[i]);
+                    return 1;
+                }
+            }
+            else if (arg == "--unordered")
+                options.Unordered = true;
+            else if (arg == "--sort-index")
+                options.SortIndex = true;
+            else if (arg == "--idx")
+                options.WriteIndexCache = true;
+            else if (arg == "--level" && i + 1 < argc)
+            {
+                options.HasLevel = true;
+                options.Level = atoi(argv[++i]);
+            }
+            else if (arg == "--stream-size" && i + 1 < argc)
+            {
+                if (!GetSizeMB(argv[++i], UINT64_MAX >> 20, options.StreamSize))
+                {
+                    printf("ERROR: Invalid stream size '%s'.", argv[i]);
+                    return 1;
+                }
+            }
+            else if (arg == "--io" && i + 1 < argc)
+                options.Io = GetIoMode(argv[++i]);
+            else if (arg == "--cache" && i + 1 < argc)
+                options.CacheDir = argv[++i];
+            else if (arg == "--cache-size" && i + 1 < argc)
+            {
+                if (!GetSizeMB(argv[++i], UINT64_MAX >> 20, options.CacheSize))
+                {
+                    printf("ERROR: Invalid cache size '%s'.", argv[i]);
+                    return 1;
+                }
+            }
+            else if (IsCodePageName(argv[i]))
+                codePage = GetCodePage(argv[i]);
+            else
+            {
+                printf("ERROR: Unknown option '%s'.", argv[i]);
+                return 1;
+            }
+        }
+
+        if (!CreatePackageMT(pacPath, dirPath, compressionMethod, codePage, options)) return 1;
+    }
+    else if (cmd == "-r")
+    {
+        if (argc < 5)
+        {
+            printf("ERROR: Required 3 arguments.");
+            return 1;
+        }
+
+        int compressionMethod = GetCompressionMethod(argv[2]);
+
+        std::string srcPath(argv[3]);
+        std::string pacPath(argv[4]);
+
+        PackOptions options;
+
+        for (int i = 5; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+
+            if (arg == "--level" && i + 1 < argc)
+            {
+                options.HasLevel = true;
+                options.Level = atoi(argv[++i]);
+            }
+            else if (arg == "--sum")
+                options.WriteChecksum = true;
+            else if (arg == "--idx")
+                options.WriteIndexCache = true;
+            else if (arg == "--io" && i + 1 < argc)
+                options.Io = GetIoMode(argv[++i]);
+            else
+            {
+                printf("ERROR: Unknown option '%s'.", argv[i]);
+                return 1;
+            }
+        }
+
+        if (!TranscodePackage(srcPath, pacPath, compressionMethod, options)) return 1;
     }
     else if (cmd == "-x")
     {
+        if (argc < 4)
+        {
+            printf("ERROR: Required 2 arguments.");
+            return 1;
+        }
+
         std::string pacPath(argv[2]);
         std::string dirPath(argv[3]);
 
-        if(argc>=5) codePage =  GetCodePage(argv[4]);
+        ExtractOptions options;
+
+        for (int i = 4; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+
+            if (arg == "--io" && i + 1 < argc)
+                options.Io = GetIoMode(argv[++i]);
+            else if (arg == "--skip-unchanged")
+                options.SkipUnchanged = true;
+            else if (IsCodePageName(argv[i]))
+                codePage = GetCodePage(argv[i]);
+            else
+            {
+                printf("ERROR: Unknown option '%s'.", argv[i]);
+                return 1;
+            }
+        }
+
+        if (!ExtractPackage(pacPath, dirPath,codePage, options)) return 1;
+    }
+    else if (cmd == "-l")
+    {
+        std::string pacPath(argv[2]);
+
+        ListFormat format = ListFormat::Text;
+
+        for (int i = 3; i < argc; i++)
+        {
+            if (IsCodePageName(argv[i])) codePage = GetCodePage(argv[i]);
+            else if (IsListFormatName(argv[i])) format = GetListFormat(argv[i]);
+            else
+            {
+                printf("ERROR: Unknown option '%s'.", argv[i]);
+                return 1;
+            }
+        }
+
+        if (!ListPackage(pacPath, format, codePage)) return 1;
+    }
+    else if (cmd == "-t")
+    {
+        std::string pacPath(argv[2]);
+
+        ExtractOptions options;
+
+        for (int i = 3; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+
+            if (arg == "--io" && i + 1 < argc)
+                options.Io = GetIoMode(argv[++i]);
+            else
+            {
+                printf("ERROR: Unknown option '%s'.", argv[i]);
+                return 1;
+            }
+        }
+
+        if (!VerifyPackage(pacPath, options)) return 1;
+    }
+    else if (cmd == "-i")
+    {
+        std::string pacPath(argv[2]);
+
+        if (!BuildIndexCache(pacPath)) return 1;
+    }
+    else if (cmd == "-b")
+    {
+        std::string pacPath(argv[2]);
+
+        uint32_t runs = argc >= 4 ? strtoul(argv[3], nullptr, 10) : 1;
 
-        ExtractPackage(pacPath, dirPath,codePage);
+        if (!BenchmarkPackage(pacPath, runs)) return 1;
     }
     else
     {
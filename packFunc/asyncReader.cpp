@@ -0,0 +1,242 @@
+#include "asyncReader.h"
+
+#include <windows.h>
+#include <cstdio>
+
+/**
+ * @brief 一次读取请求，OVERLAPPED必须是第一个成员，完成时从OVERLAPPED指针取回请求
+ */
+struct ReadRequest
+{
+    OVERLAPPED Overlapped;
+    uintptr_t Tag;
+    uint32_t Size;
+
+    // 完成时同时设置事件，完成端口出错时Cancel不经过完成端口也能等到请求结束
+    ReadRequest() : Overlapped(), Tag(0), Size(0) { this->Overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL); }
+
+    ~ReadRequest()
+    {
+        if (this->Overlapped.hEvent) CloseHandle(this->Overlapped.hEvent);
+    }
+};
+
+AsyncReader::~AsyncReader()
+{
+    this->Close();
+}
+
+/**
+ * @brief 打开文件并创建完成端口
+ *
+ * @param path 文件路径
+ * @return 函数执行结果
+ */
+bool AsyncReader::Open(const std::string &path)
+{
+    this->Close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    HANDLE port = CreateIoCompletionPort(file, NULL, 0, 1);
+
+    if (!port)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    this->_file = file;
+    this->_port = port;
+
+    return true;
+}
+
+/**
+ * @brief 等待所有读取完成后关闭文件
+ */
+void AsyncReader::Close()
+{
+    if (!this->_file) return;
+
+    // 缓冲区属于调用者，关闭之前要取回所有请求，完成端口出错时取消剩下的
+    uintptr_t tag;
+    bool succeeded;
+
+    while (!this->_pending.empty() && this->Wait(tag, succeeded))
+    {
+    }
+
+    this->Cancel();
+
+    CloseHandle((HANDLE)this->_file);
+    CloseHandle((HANDLE)this->_port);
+
+    this->_file = nullptr;
+    this->_port = nullptr;
+}
+
+/**
+ * @brief 提交一个按位置读取，不等待完成
+ *
+ * @param offset 文件内的位置
+ * @param buffer 输出缓冲区，在Wait取回这个请求之前不能释放
+ * @param size 读取的size，不能为0
+ * @param tag 调用者的标记，Wait时原样返回
+ * @return 提交失败返回false
+ */
+bool AsyncReader::Submit(uint64_t offset, void *buffer, uint32_t size, uintptr_t tag)
+{
+    auto request = new ReadRequest();
+
+    if (!request->Overlapped.hEvent)
+    {
+        delete request;
+        return false;
+    }
+
+    request->Overlapped.Offset = (DWORD)offset;
+    request->Overlapped.OffsetHigh = (DWORD)(offset >> 32);
+    request->Tag = tag;
+    request->Size = size;
+
+    // 同步完成时完成端口同样会收到通知
+    if (!ReadFile((HANDLE)this->_file, buffer, size, NULL, &request->Overlapped) && GetLastError() != ERROR_IO_PENDING)
+    {
+        delete request;
+        return false;
+    }
+
+    this->_pending.insert(request);
+
+    return true;
+}
+
+/**
+ * @brief 等待任意一个读取完成
+ *
+ * @param[out] tag 完成的请求的标记
+ * @param[out] succeeded 是否读取了完整的size
+ * @return 没有等待中的请求时返回false
+ */
+bool AsyncReader::Wait(uintptr_t &tag, bool &succeeded)
+{
+    if (this->_pending.empty()) return false;
+
+    DWORD readSize = 0;
+    ULONG_PTR key = 0;
+    LPOVERLAPPED overlapped = nullptr;
+
+    BOOL result = GetQueuedCompletionStatus((HANDLE)this->_port, &readSize, &key, &overlapped, INFINITE);
+
+    // 没有取回请求说明完成端口本身出错了
+    if (!overlapped)
+    {
+        printf("ERROR: Failed to wait for asynchronous reads (%lu).\n", (unsigned long)GetLastError());
+        return false;
+    }
+
+    auto request = reinterpret_cast<ReadRequest *>(overlapped);
+
+    tag = request->Tag;
+    succeeded = result && readSize == request->Size;
+
+    this->_pending.erase(request);
+
+    delete request;
+
+    return true;
+}
+
+/**
+ * @brief 取消所有还没有取回的读取，等它们结束之后释放请求，完成端口出错时使用
+ *
+ * 每个请求都有自己的事件，不经过完成端口也能等到它结束，返回之后调用者可以释放缓冲区
+ *
+ * @return 被取消的请求的标记
+ */
+std::vector<uintptr_t> AsyncReader::Cancel()
+{
+    std::vector<uintptr_t> tags;
+
+    if (this->_pending.empty()) return tags;
+
+    CancelIoEx((HANDLE)this->_file, NULL);
+
+    for (void *pending : this->_pending)
+    {
+        auto request = static_cast<ReadRequest *>(pending);
+        DWORD readSize = 0;
+
+        GetOverlappedResult((HANDLE)this->_file, &request->Overlapped, &readSize, TRUE);
+
+        tags.emplace_back(request->Tag);
+
+        delete request;
+    }
+
+    this->_pending.clear();
+
+    return tags;
+}
+
+/**
+ * @brief 每个线程一个手动重置的事件，用来等待自己提交的读取
+ */
+struct ThreadEvent
+{
+    HANDLE Event = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+    ~ThreadEvent()
+    {
+        if (this->Event) CloseHandle(this->Event);
+    }
+};
+
+/**
+ * @brief 按位置读取并等待完成
+ *
+ * 文件要用FILE_FLAG_OVERLAPPED打开，多个线程共用一个句柄时各自的读取可以同时进行，
+ * 没有FILE_FLAG_OVERLAPPED的句柄上系统会把所有读取排成一队
+ *
+ * @param file 文件句柄
+ * @param offset 文件内的位置
+ * @param buffer 输出缓冲区
+ * @param size 读取的size
+ * @return 没有读取完整的size时返回false
+ */
+bool ReadFileAt(void *file, uint64_t offset, void *buffer, uint32_t size)
+{
+    thread_local ThreadEvent threadEvent;
+
+    if (!threadEvent.Event) return false;
+
+    uint8_t *cursor = static_cast<uint8_t *>(buffer);
+
+    while (size > 0)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        overlapped.hEvent = threadEvent.Event;
+
+        DWORD readSize = 0;
+
+        BOOL result = ReadFile((HANDLE)file, cursor, size, NULL, &overlapped);
+
+        if (result || GetLastError() == ERROR_IO_PENDING)
+        {
+            result = GetOverlappedResult((HANDLE)file, &overlapped, &readSize, TRUE);
+        }
+
+        if (!result || readSize == 0) return false;
+
+        cursor += readSize;
+        offset += readSize;
+        size -= readSize;
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef NEXAS_ASYNC_READER_H
+#define NEXAS_ASYNC_READER_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief 异步批量读取
+ *
+ * 文件用FILE_FLAG_OVERLAPPED打开并关联到完成端口，Submit一次提交多个按位置读取，
+ * 不等待完成，Wait按完成的顺序取回结果，读取和解压可以同时进行。
+ * Submit和Wait要在同一个线程里调用
+ */
+class AsyncReader
+{
+public:
+    AsyncReader() = default;
+
+    ~AsyncReader();
+
+    AsyncReader(const AsyncReader &) = delete;
+
+    AsyncReader &operator=(const AsyncReader &) = delete;
+
+    bool Open(const std::string &path);
+
+    void Close();
+
+    uint32_t GetPendingCount() const { return (uint32_t)this->_pending.size(); }
+
+    bool Submit(uint64_t offset, void *buffer, uint32_t size, uintptr_t tag);
+
+    bool Wait(uintptr_t &tag, bool &succeeded);
+
+    std::vector<uintptr_t> Cancel();
+
+private:
+    void *_file = nullptr;          // HANDLE
+    void *_port = nullptr;          // 完成端口
+    std::unordered_set<void *> _pending;    // 已经提交还没有取回的读取(ReadRequest)
+};
+
+bool ReadFileAt(void *file, uint64_t offset, void *buffer, uint32_t size);
+
+#endif // NEXAS_ASYNC_READER_H
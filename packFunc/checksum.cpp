@@ -0,0 +1,148 @@
+#include "checksum.h"
+
+#include "hash.hpp"
+#include "indexCache.h"
+
+#include <windows.h>
+#include <cstring>
+
+// .sum文件格式: magic(4) + version(4) + count(4) + PackageStamp + ChecksumEntry[count]
+// 版本3开始记录封包的标记，之前的版本无法判断是否和封包对应，不再使用
+static const uint8_t ChecksumMagic[] = {0x50, 0x53, 0x55, 0x4D}; // PSUM
+static const uint32_t ChecksumVersion = 3;
+
+/**
+ * @brief 获取整个封包的标记
+ *
+ * 只有一卷时和.idx的标记相同，分卷时size为所有分卷的和，TailHash合并了每个分卷的标记
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @param[out] stamp 封包的标记
+ * @return 函数执行结果
+ */
+static bool GetChecksumStamp(const std::string &pacPath, PackageStamp &stamp)
+{
+    auto volumePaths = FindVolumePaths(pacPath);
+
+    if (!GetPackageStamp(volumePaths[0], stamp)) return false;
+
+    for (size_t volume = 1; volume < volumePaths.size(); volume++)
+    {
+        PackageStamp volumeStamp;
+
+        if (!GetPackageStamp(volumePaths[volume], volumeStamp)) return false;
+
+        uint64_t values[] = {stamp.TailHash, volumeStamp.PackageSize, (uint64_t)volumeStamp.ModifyTime, volumeStamp.TailHash};
+
+        stamp.PackageSize += volumeStamp.PackageSize;
+        stamp.TailHash = XXHash64::Compute(values, sizeof(values));
+    }
+
+    return true;
+}
+
+/**
+ * @brief 写入封包旁边的.sum文件，封包的所有分卷必须已经写完
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @param entries 每个文件的记录
+ * @return 函数执行结果
+ */
+bool WriteChecksumFile(const std::string &pacPath, const std::vector<ChecksumEntry> &entries)
+{
+    PackageStamp stamp;
+
+    if (!GetChecksumStamp(pacPath, stamp)) return false;
+
+    FILE *fp = fopen(GetChecksumPath(pacPath).c_str(), "wb");
+
+    if (!fp)
+    {
+        printf("ERROR: Failed to create checksum file.");
+        return false;
+    }
+
+    uint32_t count = entries.size();
+
+    fwrite(ChecksumMagic, 4, 1, fp);
+    fwrite(&ChecksumVersion, 4, 1, fp);
+    fwrite(&count, 4, 1, fp);
+    fwrite(&stamp, sizeof(stamp), 1, fp);
+
+    bool result = count == 0 || fwrite(entries.data(), sizeof(ChecksumEntry) * count, 1, fp) == 1;
+
+    if (fclose(fp) != 0) result = false;
+
+    return result;
+}
+
+/**
+ * @brief 读取.sum文件，不检查是否和封包对应
+ *
+ * @param path .sum文件路径
+ * @param entries 输出每个文件的记录
+ * @param[out] stamp 写入.sum时封包的标记，为nullptr时不输出
+ * @return 文件不存在或者格式不对返回false
+ */
+bool ReadChecksumFile(const std::string &path, std::vector<ChecksumEntry> &entries, PackageStamp *stamp)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp) return false;
+
+    uint8_t magic[4];
+    uint32_t version = 0;
+    uint32_t count = 0;
+    PackageStamp fileStamp;
+
+    _fseeki64(fp, 0, SEEK_END);
+    int64_t fileSize = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+
+    // 分配之前先用文件size检查count，截断或者损坏的.sum当作没有
+    if (fread(magic, 4, 1, fp) != 1 || fread(&version, 4, 1, fp) != 1 || memcmp(magic, ChecksumMagic, 4) != 0 || version != ChecksumVersion ||
+        fread(&count, 4, 1, fp) != 1 || fread(&fileStamp, sizeof(fileStamp), 1, fp) != 1 ||
+        (uint64_t)fileSize != 12 + sizeof(PackageStamp) + (uint64_t)count * sizeof(ChecksumEntry))
+    {
+        fclose(fp);
+        return false;
+    }
+
+    entries.assign(count, ChecksumEntry());
+
+    bool result = count == 0 || fread(entries.data(), sizeof(ChecksumEntry) * count, 1, fp) == 1;
+
+    fclose(fp);
+
+    if (!result) entries.clear();
+
+    if (result && stamp) *stamp = fileStamp;
+
+    return result;
+}
+
+/**
+ * @brief 读取封包旁边的.sum，只接受写入之后封包没有改变过的
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @param entries 输出每个文件的记录
+ * @return 没有.sum、格式不对或者封包已经改变时返回false
+ */
+bool ReadPackageChecksums(const std::string &pacPath, std::vector<ChecksumEntry> &entries)
+{
+    PackageStamp stamp;
+    PackageStamp current;
+
+    auto path = GetChecksumPath(pacPath);
+
+    if (GetFileAttributesA(path.c_str()) == INVALID_FILE_ATTRIBUTES) return false;
+
+    if (!ReadChecksumFile(path, entries, &stamp) || !GetChecksumStamp(pacPath, current) || !(stamp == current))
+    {
+        printf("WARNING: Checksum file '%s' is out of date, ignored.\n", path.c_str());
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef NEXAS_CHECKSUM_H
+#define NEXAS_CHECKSUM_H
+
+#include "packFunc.h"
+
+/**
+ * @brief 封包旁边的.sum文件里每个文件的记录，顺序和封包索引一致
+ */
+struct ChecksumEntry
+{
+    char          Name[0x40];
+    uint32_t      OriginalSize;
+    uint32_t      CompressedSize;
+    int64_t       ModifyTime;       // 源文件修改时间
+    uint64_t      OriginalHash;     // 原始数据的XXH64
+    uint64_t      CompressedHash;   // 封包里数据的XXH64
+};
+
+static_assert(sizeof(ChecksumEntry) == 0x60, "The size of ChecksumEntry must be 60");
+
+inline std::string GetChecksumPath(const std::string &pacPath)
+{
+    return pacPath + ".sum";
+}
+
+struct PackageStamp;
+
+bool WriteChecksumFile(const std::string &pacPath, const std::vector<ChecksumEntry> &entries);
+
+bool ReadChecksumFile(const std::string &path, std::vector<ChecksumEntry> &entries, PackageStamp *stamp = nullptr);
+
+bool ReadPackageChecksums(const std::string &pacPath, std::vector<ChecksumEntry> &entries);
+
+#endif // NEXAS_CHECKSUM_H
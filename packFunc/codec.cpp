@@ -0,0 +1,445 @@
+#include "codec.h"
+
+#include "quote/header/zlib.h"
+#include "quote/header/zstd.h"
+
+#include <cstring>
+
+/**
+ * @brief 获取封包时默认的压缩等级
+ *
+ * @param compressionMethod 压缩方式
+ * @return 压缩等级，zlib为Z_BEST_COMPRESSION，zstd为最高等级
+ */
+int GetDefaultCompressionLevel(uint32_t compressionMethod)
+{
+    if (compressionMethod == 4)
+        return Z_BEST_COMPRESSION;
+    else if (compressionMethod == 7)
+        return ZSTD_maxCLevel();
+    return 0;
+}
+
+/**
+ * @brief 获取压缩库的版本号，不同版本的压缩结果可能不同
+ */
+uint32_t GetCompressorVersion(uint32_t compressionMethod)
+{
+    if (compressionMethod == 4)
+        return ZLIB_VERNUM;
+    else if (compressionMethod == 7)
+        return ZSTD_versionNumber();
+    return 0;
+}
+
+/**
+ * @brief 压缩数据
+ *
+ * @param compressionMethod 压缩方式，4为zlib，7为zstd
+ * @param level 压缩等级
+ * @param src 源数据
+ * @param srcSize 源数据size
+ * @param dst 输出压缩后的数据
+ * @return 函数执行结果
+ */
+bool CompressData(uint32_t compressionMethod, int level, const uint8_t *src, size_t srcSize, std::vector<uint8_t> &dst)
+{
+    if (compressionMethod == 4)
+    {
+        uLong sourceLen = srcSize;
+        uLong destLen = compressBound(sourceLen);
+
+        dst.resize(destLen);
+
+        int result = compress2(dst.data(), &destLen, src, sourceLen, level);
+
+        if (result != Z_OK)
+        {
+            dst.clear();
+            return false;
+        }
+
+        dst.resize(destLen);
+    }
+    else if (compressionMethod == 7)
+    {
+        size_t dstSize = ZSTD_compressBound(srcSize);
+
+        dst.resize(dstSize);
+
+        size_t result = ZSTD_compress(dst.data(), dstSize, src, srcSize, level);
+
+        if (ZSTD_isError(result))
+        {
+            dst.clear();
+            return false;
+        }
+
+        dst.resize(result);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// 分块压缩时每次读取和输出的size
+static const size_t StreamChunkSize = 1024 * 1024;
+
+/**
+ * @brief 用zlib分块压缩，输出和compress2一样是zlib格式
+ */
+static bool DeflateStream(int level, const StreamReader &reader, const StreamWriter &writer)
+{
+    z_stream stream = {};
+
+    if (deflateInit(&stream, level) != Z_OK) return false;
+
+    std::vector<uint8_t> input(StreamChunkSize);
+    std::vector<uint8_t> output(StreamChunkSize);
+    bool result = true;
+    int flush = Z_NO_FLUSH;
+
+    while (result && flush != Z_FINISH)
+    {
+        size_t readSize = 0;
+
+        if (!reader(input.data(), input.size(), readSize))
+        {
+            result = false;
+            break;
+        }
+
+        if (readSize == 0) flush = Z_FINISH;
+
+        stream.next_in = input.data();
+        stream.avail_in = (uInt)readSize;
+
+        // 输入全部消耗完之后再读取下一块，Z_FINISH时直到输出完所有数据
+        do
+        {
+            stream.next_out = output.data();
+            stream.avail_out = (uInt)output.size();
+
+            int status = deflate(&stream, flush);
+
+            if (status == Z_STREAM_ERROR)
+            {
+                result = false;
+                break;
+            }
+
+            size_t outputSize = output.size() - stream.avail_out;
+
+            if (outputSize && !writer(output.data(), outputSize))
+            {
+                result = false;
+                break;
+            }
+
+        } while (stream.avail_out == 0);
+    }
+
+    deflateEnd(&stream);
+
+    return result;
+}
+
+/**
+ * @brief 用zstd分块压缩，结果是带原始size的单个frame
+ */
+static bool ZstdCompressStream(int level, uint64_t srcSize, const StreamReader &reader, const StreamWriter &writer)
+{
+    ZSTD_CCtx *context = ZSTD_createCCtx();
+
+    if (!context) return false;
+
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+    ZSTD_CCtx_setPledgedSrcSize(context, srcSize);
+
+    std::vector<uint8_t> input(StreamChunkSize);
+    std::vector<uint8_t> output(ZSTD_CStreamOutSize());
+    bool result = true;
+    bool finished = false;
+
+    while (result && !finished)
+    {
+        size_t readSize = 0;
+
+        if (!reader(input.data(), input.size(), readSize))
+        {
+            result = false;
+            break;
+        }
+
+        ZSTD_EndDirective mode = readSize == 0 ? ZSTD_e_end : ZSTD_e_continue;
+        ZSTD_inBuffer inBuffer = {input.data(), readSize, 0};
+
+        // continue时直到输入全部消耗完，end时直到返回0表示frame结束
+        while (true)
+        {
+            ZSTD_outBuffer outBuffer = {output.data(), output.size(), 0};
+
+            size_t remaining = ZSTD_compressStream2(context, &outBuffer, &inBuffer, mode);
+
+            if (ZSTD_isError(remaining))
+            {
+                printf("ERROR: Failed to compress with zstd(%s).\n", ZSTD_getErrorName(remaining));
+                result = false;
+                break;
+            }
+
+            if (outBuffer.pos && !writer(output.data(), outBuffer.pos))
+            {
+                result = false;
+                break;
+            }
+
+            if (mode == ZSTD_e_end ? remaining == 0 : inBuffer.pos == inBuffer.size)
+            {
+                finished = mode == ZSTD_e_end;
+                break;
+            }
+        }
+    }
+
+    ZSTD_freeCCtx(context);
+
+    return result;
+}
+
+/**
+ * @brief 分块压缩，内存占用只和压缩等级有关，和数据size无关
+ *
+ * @param compressionMethod 压缩方式，4为zlib，7为zstd
+ * @param level 压缩等级
+ * @param srcSize 源数据的总size，zstd写在frame头里
+ * @param reader 读取源数据
+ * @param writer 输出压缩后的数据
+ * @return 函数执行结果，读取失败或者writer返回false都返回false
+ */
+bool CompressStream(uint32_t compressionMethod, int level, uint64_t srcSize, const StreamReader &reader, const StreamWriter &writer)
+{
+    if (compressionMethod == 4)
+        return DeflateStream(level, reader, writer);
+    else if (compressionMethod == 7)
+        return ZstdCompressStream(level, srcSize, reader, writer);
+    return false;
+}
+
+/**
+ * @brief 用zlib分块解压
+ *
+ * @param[out] outputSize 解压后的size
+ */
+static bool InflateStream(const StreamReader &reader, const StreamWriter &writer, uint64_t &outputSize)
+{
+    z_stream stream = {};
+
+    if (inflateInit(&stream) != Z_OK) return false;
+
+    std::vector<uint8_t> input(StreamChunkSize);
+    std::vector<uint8_t> output(StreamChunkSize);
+    int status = Z_OK;
+
+    while (status != Z_STREAM_END)
+    {
+        size_t readSize = 0;
+
+        // 数据读完了还没有结束就是数据不完整
+        if (!reader(input.data(), input.size(), readSize) || readSize == 0) break;
+
+        stream.next_in = input.data();
+        stream.avail_in = (uInt)readSize;
+
+        do
+        {
+            stream.next_out = output.data();
+            stream.avail_out = (uInt)output.size();
+
+            status = inflate(&stream, Z_NO_FLUSH);
+
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) break;
+
+            size_t size = output.size() - stream.avail_out;
+
+            if (size && !writer(output.data(), size))
+            {
+                status = Z_DATA_ERROR;
+                break;
+            }
+
+            outputSize += size;
+
+        } while (status != Z_STREAM_END && stream.avail_out == 0);
+
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) break;
+    }
+
+    bool result = status == Z_STREAM_END;
+
+    inflateEnd(&stream);
+
+    return result;
+}
+
+/**
+ * @brief 用zstd分块解压
+ *
+ * @param[out] outputSize 解压后的size
+ */
+static bool ZstdDecompressStream(const StreamReader &reader, const StreamWriter &writer, uint64_t &outputSize)
+{
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+
+    if (!context) return false;
+
+    std::vector<uint8_t> input(ZSTD_DStreamInSize());
+    std::vector<uint8_t> output(ZSTD_DStreamOutSize());
+    size_t remaining = 1;   // 为0时frame已经结束
+    bool result = true;
+
+    while (result)
+    {
+        size_t readSize = 0;
+
+        if (!reader(input.data(), input.size(), readSize))
+        {
+            result = false;
+            break;
+        }
+
+        if (readSize == 0)
+        {
+            result = remaining == 0;
+            break;
+        }
+
+        ZSTD_inBuffer inBuffer = {input.data(), readSize, 0};
+        bool flushing = true;
+
+        // 输入消耗完之后，输出缓冲区满了时可能还有数据没有输出
+        while (inBuffer.pos < inBuffer.size || flushing)
+        {
+            ZSTD_outBuffer outBuffer = {output.data(), output.size(), 0};
+
+            remaining = ZSTD_decompressStream(context, &outBuffer, &inBuffer);
+
+            if (ZSTD_isError(remaining))
+            {
+                printf("ERROR: Failed to uncompress with zstd(%s).\n", ZSTD_getErrorName(remaining));
+                result = false;
+                break;
+            }
+
+            if (outBuffer.pos && !writer(output.data(), outBuffer.pos))
+            {
+                result = false;
+                break;
+            }
+
+            outputSize += outBuffer.pos;
+            flushing = outBuffer.pos == outBuffer.size;
+        }
+    }
+
+    ZSTD_freeDCtx(context);
+
+    return result;
+}
+
+/**
+ * @brief 分块解压，内存占用和数据size无关
+ *
+ * @param compressionMethod 压缩方式，4为zlib，7为zstd
+ * @param originalSize 解压后应有的size
+ * @param reader 读取压缩数据，readSize为0表示读完
+ * @param writer 输出解压后的数据
+ * @return 函数执行结果，数据不完整、解压失败或者解压后size不对都返回false
+ */
+bool DecompressStream(uint32_t compressionMethod, uint64_t originalSize, const StreamReader &reader, const StreamWriter &writer)
+{
+    uint64_t outputSize = 0;
+    bool result;
+
+    if (compressionMethod == 4)
+        result = InflateStream(reader, writer, outputSize);
+    else if (compressionMethod == 7)
+        result = ZstdDecompressStream(reader, writer, outputSize);
+    else
+    {
+        printf("ERROR: Unsupported compression method %u.\n", compressionMethod);
+        return false;
+    }
+
+    if (result && outputSize != originalSize)
+    {
+        printf("ERROR: Size mismatch (%llu != %llu).\n", (unsigned long long)outputSize, (unsigned long long)originalSize);
+        return false;
+    }
+
+    return result;
+}
+
+/**
+ * @brief 解压单个文件
+ *
+ * @param compressionMethod 封包压缩方式
+ * @param entry 文件索引
+ * @param src 压缩数据，size为entry.CompressedSize
+ * @param dst 输出缓冲区，size至少为GetEntryOutputSize()
+ * @return 函数执行结果，解压失败或者解压后size不对都返回false
+ */
+bool DecompressEntry(uint32_t compressionMethod, const PackageEntry &entry, const uint8_t *src, uint8_t *dst)
+{
+    if (IsStoredEntry(compressionMethod, entry))
+    {
+        memcpy(dst, src, entry.CompressedSize);
+        return true;
+    }
+
+    if (compressionMethod == 4)
+    {
+        uLong sourceLen = entry.CompressedSize;
+        uLongf destLen = entry.OriginalSize;
+
+        int result = uncompress((Bytef *)dst, &destLen, (const Bytef *)src, sourceLen);
+
+        if (result != Z_OK)
+        {
+            printf("ERROR: Failed to uncompress %.64s with zlib.\n", entry.Name);
+            return false;
+        }
+
+        if (destLen != entry.OriginalSize)
+        {
+            printf("ERROR: Size mismatch of %.64s (%lu != %u).\n", entry.Name, (unsigned long)destLen, entry.OriginalSize);
+            return false;
+        }
+    }
+    else if (compressionMethod == 7)
+    {
+        size_t result = ZSTD_decompress(dst, entry.OriginalSize, src, entry.CompressedSize);
+
+        if (ZSTD_isError(result))
+        {
+            printf("ERROR: Failed to uncompress %.64s with zstd(%s).\n", entry.Name, ZSTD_getErrorName(result));
+            return false;
+        }
+
+        if (result != entry.OriginalSize)
+        {
+            printf("ERROR: Size mismatch of %.64s (%zu != %u).\n", entry.Name, result, entry.OriginalSize);
+            return false;
+        }
+    }
+    else
+    {
+        printf("ERROR: Unsupported compression method %u.\n", compressionMethod);
+        return false;
+    }
+
+    return true;
+}
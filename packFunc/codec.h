@@ -0,0 +1,44 @@
+#ifndef NEXAS_CODEC_H
+#define NEXAS_CODEC_H
+
+#include "packFunc.h"
+
+#include <functional>
+
+/**
+ * @brief 判断文件是否未压缩直接存储
+ *
+ * 封包里压缩前后size相同的文件都是直接存储的
+ */
+inline bool IsStoredEntry(uint32_t compressionMethod, const PackageEntry &entry)
+{
+    return compressionMethod == 0 || entry.OriginalSize == entry.CompressedSize;
+}
+
+/**
+ * @brief 获取文件解压后的size
+ */
+inline uint32_t GetEntryOutputSize(uint32_t compressionMethod, const PackageEntry &entry)
+{
+    return IsStoredEntry(compressionMethod, entry) ? entry.CompressedSize : entry.OriginalSize;
+}
+
+int GetDefaultCompressionLevel(uint32_t compressionMethod);
+
+uint32_t GetCompressorVersion(uint32_t compressionMethod);
+
+bool CompressData(uint32_t compressionMethod, int level, const uint8_t *src, size_t srcSize, std::vector<uint8_t> &dst);
+
+// 分块读取源数据，readSize为0表示读完，读取失败时返回false
+using StreamReader = std::function<bool(uint8_t *buffer, size_t bufferSize, size_t &readSize)>;
+
+// 输出一块压缩后的数据，返回false时停止压缩
+using StreamWriter = std::function<bool(const uint8_t *data, size_t size)>;
+
+bool CompressStream(uint32_t compressionMethod, int level, uint64_t srcSize, const StreamReader &reader, const StreamWriter &writer);
+
+bool DecompressStream(uint32_t compressionMethod, uint64_t originalSize, const StreamReader &reader, const StreamWriter &writer);
+
+bool DecompressEntry(uint32_t compressionMethod, const PackageEntry &entry, const uint8_t *src, uint8_t *dst);
+
+#endif // NEXAS_CODEC_H
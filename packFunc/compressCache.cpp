@@ -0,0 +1,195 @@
+#include "compressCache.h"
+
+#include "codec.h"
+#include "hash.hpp"
+
+#include <windows.h>
+#include <shlobj.h>
+#include <io.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#include <algorithm>
+#include <thread>
+#include <sstream>
+
+#undef min
+#undef max
+
+// 缓存文件格式: magic(4) + 压缩数据的XXH64(8) + 压缩数据
+static const uint8_t CacheMagic[] = {0x50, 0x43, 0x43, 0x31}; // PCC1
+
+/**
+ * @brief 创建缓存目录
+ *
+ * @return 函数执行结果
+ */
+bool CompressCache::Open()
+{
+    SHCreateDirectoryExA(NULL, this->_dirPath.c_str(), NULL);
+
+    struct _stat64 s;
+
+    if (_stat64(this->_dirPath.c_str(), &s) != 0 || (s.st_mode & _S_IFDIR) == 0)
+    {
+        printf("WARNING: Failed to create cache directory '%s', cache disabled.\n", this->_dirPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+std::string CompressCache::GetEntryPath(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level) const
+{
+    char name[96];
+    snprintf(name, sizeof(name), "%016llx-%08x-m%u-l%d-v%u.bin", (unsigned long long)hash, originalSize, compressionMethod, level,
+             GetCompressorVersion(compressionMethod));
+
+    return this->_dirPath + "\\" + name;
+}
+
+/**
+ * @brief 查找缓存的压缩数据
+ *
+ * @param[in] hash 原始数据的XXH64
+ * @param[in] originalSize 原始size
+ * @param[in] compressionMethod 压缩方式
+ * @param[in] level 压缩等级
+ * @param[out] data 压缩后的数据
+ * @return 是否命中
+ */
+bool CompressCache::Get(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level, std::vector<uint8_t> &data)
+{
+    auto path = this->GetEntryPath(hash, originalSize, compressionMethod, level);
+
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp)
+    {
+        this->_misses++;
+        return false;
+    }
+
+    uint8_t magic[4];
+    uint64_t dataHash = 0;
+
+    _fseeki64(fp, 0, SEEK_END);
+    int64_t fileSize = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+
+    bool result = fileSize > 12 && fread(magic, 4, 1, fp) == 1 && memcmp(magic, CacheMagic, 4) == 0 && fread(&dataHash, 8, 1, fp) == 1;
+
+    if (result)
+    {
+        data.resize((size_t)(fileSize - 12));
+        result = fread(data.data(), data.size(), 1, fp) == 1 && XXHash64::Compute(data.data(), data.size()) == dataHash;
+    }
+
+    fclose(fp);
+
+    if (!result)
+    {
+        // 损坏的缓存直接删掉，之后重新生成
+        DeleteFileA(path.c_str());
+        data.clear();
+        this->_misses++;
+        return false;
+    }
+
+    // 更新修改时间，用于淘汰
+    _utime64(path.c_str(), NULL);
+
+    this->_hits++;
+    this->_savedBytes += originalSize;
+
+    return true;
+}
+
+/**
+ * @brief 保存压缩数据
+ *
+ * 先写到临时文件再改名，多个进程同时写同一个key也不会读到不完整的数据
+ */
+void CompressCache::Put(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level, const std::vector<uint8_t> &data)
+{
+    auto path = this->GetEntryPath(hash, originalSize, compressionMethod, level);
+
+    std::ostringstream tempPath;
+    tempPath << path << "." << std::this_thread::get_id() << ".tmp";
+
+    FILE *fp = fopen(tempPath.str().c_str(), "wb");
+
+    if (!fp) return;
+
+    uint64_t dataHash = XXHash64::Compute(data.data(), data.size());
+
+    bool result = fwrite(CacheMagic, 4, 1, fp) == 1 && fwrite(&dataHash, 8, 1, fp) == 1 && fwrite(data.data(), data.size(), 1, fp) == 1;
+
+    fclose(fp);
+
+    if (!result || !MoveFileExA(tempPath.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileA(tempPath.str().c_str());
+    }
+}
+
+/**
+ * @brief 按修改时间淘汰旧的缓存，直到总size不超过上限
+ */
+void CompressCache::Trim()
+{
+    struct CacheFile
+    {
+        std::string Path;
+        int64_t Size;
+        int64_t ModifyTime;
+    };
+
+    std::vector<CacheFile> files;
+    uint64_t totalSize = 0;
+
+    _finddata64_t data;
+    intptr_t handle = _findfirst64((this->_dirPath + "\\*.bin").c_str(), &data);
+
+    if (handle != -1)
+    {
+        do
+        {
+            if (data.attrib & _A_SUBDIR) continue;
+
+            files.push_back({this->_dirPath + "\\" + data.name, data.size, data.time_write});
+            totalSize += data.size;
+        } while (_findnext64(handle, &data) == 0);
+
+        _findclose(handle);
+    }
+
+    if (totalSize > this->_maxSize)
+    {
+        std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b)
+                  { return a.ModifyTime < b.ModifyTime; });
+
+        for (const auto &file : files)
+        {
+            if (totalSize <= this->_maxSize) break;
+
+            if (DeleteFileA(file.Path.c_str()))
+            {
+                totalSize -= file.Size;
+                this->_evictedCount++;
+                this->_evictedBytes += file.Size;
+            }
+        }
+    }
+
+    this->_totalSize = totalSize;
+}
+
+void CompressCache::PrintStats() const
+{
+    uint32_t hits = this->_hits;
+    uint32_t lookups = hits + this->_misses;
+
+    printf("Compression cache: %u hits, %u misses (%.1f%% hit rate), skipped compressing %.2f MB, evicted %u files (%.2f MB), %.2f MB cached.\n",
+           hits, lookups - hits, lookups ? hits * 100.0 / lookups : 0.0, this->_savedBytes / 1048576.0, this->_evictedCount,
+           this->_evictedBytes / 1048576.0, this->_totalSize / 1048576.0);
+}
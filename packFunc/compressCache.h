@@ -0,0 +1,48 @@
+#ifndef NEXAS_COMPRESS_CACHE_H
+#define NEXAS_COMPRESS_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 磁盘上的压缩结果缓存
+ *
+ * 以(原始数据hash, 原始size, 压缩方式, 压缩等级, 压缩库版本)为key保存压缩后的数据，
+ * 不同的封包之间共享，相同内容的文件只需要压缩一次。
+ * 命中时更新文件的修改时间，Trim时按修改时间从旧到新删除，直到总size不超过上限
+ */
+class CompressCache
+{
+public:
+    CompressCache(const std::string &dirPath, uint64_t maxSize) : _dirPath(dirPath), _maxSize(maxSize) {}
+
+    ~CompressCache() = default;
+
+    bool Open();
+
+    bool Get(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level, std::vector<uint8_t> &data);
+
+    void Put(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level, const std::vector<uint8_t> &data);
+
+    void Trim();
+
+    void PrintStats() const;
+
+private:
+    std::string GetEntryPath(uint64_t hash, uint32_t originalSize, uint32_t compressionMethod, int level) const;
+
+private:
+    std::string _dirPath;
+    uint64_t _maxSize = 0;
+
+    std::atomic<uint32_t> _hits{0};
+    std::atomic<uint32_t> _misses{0};
+    std::atomic<uint64_t> _savedBytes{0};   // 命中时省下的压缩量(原始size)
+    uint32_t _evictedCount = 0;
+    uint64_t _evictedBytes = 0;
+    uint64_t _totalSize = 0;
+};
+
+#endif // NEXAS_COMPRESS_CACHE_H
@@ -0,0 +1,145 @@
+#include "dirScanner.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <io.h>
+
+/**
+ * @brief 所有遍历线程共享的状态
+ */
+struct ScanState
+{
+    std::mutex Mutex;
+    std::condition_variable Condition;
+    std::deque<std::string> Directories;    // 等待遍历的文件夹
+    unsigned BusyCount = 0;                 // 正在遍历文件夹的线程数，为0并且队列为空时遍历结束
+    std::vector<ScannedFile> Files;
+};
+
+/**
+ * @brief 判断是不是"."或者".."这样的特殊文件夹
+ */
+static bool IsSpecialDirectory(const char *name)
+{
+    for (const char *p = name; *p; p++)
+    {
+        if (*p != '.') return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 遍历一个文件夹，不进入子文件夹
+ *
+ * @param[in] directory 文件夹路径
+ * @param[out] files 文件追加到这里
+ * @param[out] subDirectories 子文件夹追加到这里
+ */
+static void ScanOneDirectory(const std::string &directory, std::vector<ScannedFile> &files, std::vector<std::string> &subDirectories)
+{
+    std::string pattern;
+    pattern.reserve(directory.size() + 4);
+    pattern.append(directory);
+    pattern.append("\\*.*");
+
+    _finddata64_t data;
+    intptr_t handle = _findfirst64(pattern.c_str(), &data);
+
+    if (handle == -1) return;  // 忽略无效的路径
+
+    do
+    {
+        std::string newPath;
+        newPath.reserve(directory.size() + 1 + strlen(data.name));
+        newPath.append(directory);
+        newPath.push_back('\\');
+        newPath.append(data.name);
+
+        if (data.attrib & _A_SUBDIR)
+        {
+            if (!IsSpecialDirectory(data.name)) subDirectories.emplace_back(std::move(newPath));
+        }
+        else
+        {
+            ScannedFile file;
+            file.Path = std::move(newPath);
+            file.Size = (uint64_t)data.size;
+            file.ModifyTime = (int64_t)data.time_write;
+            files.emplace_back(std::move(file));
+        }
+
+    } while (_findnext64(handle, &data) == 0);
+
+    _findclose(handle);
+}
+
+/**
+ * @brief 遍历线程，直到没有文件夹可以遍历
+ */
+static void ScanWorker(ScanState *state)
+{
+    std::vector<ScannedFile> files;
+    std::vector<std::string> subDirectories;
+
+    while (true)
+    {
+        std::string directory;
+
+        {
+            std::unique_lock<std::mutex> lock(state->Mutex);
+
+            state->Condition.wait(lock, [state] { return !state->Directories.empty() || state->BusyCount == 0; });
+
+            if (state->Directories.empty()) break;
+
+            directory = std::move(state->Directories.front());
+            state->Directories.pop_front();
+            state->BusyCount++;
+        }
+
+        ScanOneDirectory(directory, files, subDirectories);
+
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+
+            for (auto &subDirectory : subDirectories) state->Directories.emplace_back(std::move(subDirectory));
+
+            state->BusyCount--;
+        }
+
+        subDirectories.clear();
+        state->Condition.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(state->Mutex);
+
+    state->Files.insert(state->Files.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+}
+
+std::vector<ScannedFile> ScanDirectory(const std::string &path, unsigned threadCount)
+{
+    // 遍历主要是在等待IO，网络路径上更明显，所以线程数不少于4
+    if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 4u);
+
+    ScanState state;
+    state.Directories.emplace_back(path);
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (unsigned i = 1; i < threadCount; i++) threads.emplace_back(ScanWorker, &state);
+
+    ScanWorker(&state);
+
+    for (auto &thread : threads) thread.join();
+
+    std::sort(state.Files.begin(), state.Files.end(), [](const ScannedFile &a, const ScannedFile &b)
+              { return _stricmp(a.Path.c_str(), b.Path.c_str()) < 0; });
+
+    return std::move(state.Files);
+}
@@ -0,0 +1,32 @@
+#ifndef NEXAS_DIR_SCANNER_H
+#define NEXAS_DIR_SCANNER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 遍历文件夹得到的文件信息
+ *
+ * size和修改时间在遍历的时候一起得到，后面不需要再stat
+ */
+struct ScannedFile
+{
+    std::string Path;           // 文件完整路径
+    uint64_t Size = 0;          // 文件size
+    int64_t ModifyTime = 0;     // 文件修改时间
+};
+
+/**
+ * @brief 多线程遍历目标文件夹以及子文件夹
+ *
+ * 所有线程共享一个待遍历的文件夹队列，每个线程取出一个文件夹遍历，子文件夹放回队列。
+ * 结果按路径排序(不区分大小写)，保证每次封包的顺序相同
+ *
+ * @param path 目标文件夹路径
+ * @param threadCount 线程数，0为自动
+ * @return 文件列表
+ */
+std::vector<ScannedFile> ScanDirectory(const std::string &path, unsigned threadCount = 0);
+
+#endif // NEXAS_DIR_SCANNER_H
@@ -0,0 +1,113 @@
+#include "entryCache.h"
+
+EntryCache::EntryCache(size_t byteBudget, uint32_t shardCount)
+{
+    if (shardCount == 0) shardCount = 1;
+
+    this->_shards.reserve(shardCount);
+
+    for (uint32_t i = 0; i < shardCount; i++)
+    {
+        this->_shards.emplace_back(new Shard());
+    }
+
+    this->_shardBudget = byteBudget / shardCount;
+}
+
+/**
+ * @brief 查找缓存，命中时移到LRU头部
+ *
+ * @param index 文件index
+ * @return 缓存的数据，未命中返回nullptr
+ */
+EntryData EntryCache::Get(uint32_t index)
+{
+    auto &shard = this->GetShard(index);
+
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+
+    auto it = shard.Map.find(index);
+
+    if (it == shard.Map.end())
+    {
+        this->_misses++;
+        return nullptr;
+    }
+
+    shard.Lru.splice(shard.Lru.begin(), shard.Lru, it->second);
+    this->_hits++;
+
+    return it->second->second;
+}
+
+/**
+ * @brief 放入缓存，超出分片预算时从LRU尾部淘汰
+ *
+ * 多个线程同时解压同一个文件时，以先放入的为准
+ *
+ * @param index 文件index
+ * @param data 解压后的数据
+ * @return 缓存里的数据
+ */
+EntryData EntryCache::Put(uint32_t index, EntryData data)
+{
+    if (!data || data->size() > this->_shardBudget)
+    {
+        return data;
+    }
+
+    auto &shard = this->GetShard(index);
+
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+
+    auto it = shard.Map.find(index);
+
+    if (it != shard.Map.end())
+    {
+        shard.Lru.splice(shard.Lru.begin(), shard.Lru, it->second);
+        return it->second->second;
+    }
+
+    while (!shard.Lru.empty() && shard.Bytes + data->size() > this->_shardBudget)
+    {
+        auto &victim = shard.Lru.back();
+        shard.Bytes -= victim.second->size();
+        shard.Map.erase(victim.first);
+        shard.Lru.pop_back();
+        this->_evictions++;
+    }
+
+    shard.Lru.emplace_front(index, data);
+    shard.Map.emplace(index, shard.Lru.begin());
+    shard.Bytes += data->size();
+
+    return data;
+}
+
+void EntryCache::Clear()
+{
+    for (auto &shard : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->Mutex);
+        shard->Lru.clear();
+        shard->Map.clear();
+        shard->Bytes = 0;
+    }
+}
+
+EntryCacheStats EntryCache::GetStats()
+{
+    EntryCacheStats stats;
+    stats.Hits = this->_hits;
+    stats.Misses = this->_misses;
+    stats.Evictions = this->_evictions;
+
+    for (auto &shard : this->_shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->Mutex);
+        stats.Bytes += shard->Bytes;
+        stats.Count += shard->Map.size();
+    }
+
+    return stats;
+}
@@ -0,0 +1,66 @@
+#ifndef NEXAS_ENTRY_CACHE_H
+#define NEXAS_ENTRY_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 解压后的文件数据，缓存命中时共享同一份只读数据
+using EntryData = std::shared_ptr<const std::vector<uint8_t>>;
+
+struct EntryCacheStats
+{
+    uint64_t Hits = 0;
+    uint64_t Misses = 0;
+    uint64_t Evictions = 0;
+    uint64_t Bytes = 0;     // 当前缓存的字节数
+    uint64_t Count = 0;     // 当前缓存的文件数
+};
+
+/**
+ * @brief 按字节预算淘汰的LRU缓存，以文件index为key
+ *
+ * 按index分成多个分片，每个分片有自己的锁和LRU链表，
+ * 预算平均分给每个分片，超过分片预算的数据不缓存
+ */
+class EntryCache
+{
+private:
+    struct Shard
+    {
+        std::mutex Mutex;
+        std::list<std::pair<uint32_t, EntryData>> Lru; // 头部是最近使用的
+        std::unordered_map<uint32_t, std::list<std::pair<uint32_t, EntryData>>::iterator> Map;
+        size_t Bytes = 0;
+    };
+
+    Shard &GetShard(uint32_t index) { return *this->_shards[index % this->_shards.size()]; }
+
+public:
+    EntryCache(size_t byteBudget, uint32_t shardCount);
+
+    ~EntryCache() = default;
+
+    EntryData Get(uint32_t index);
+
+    EntryData Put(uint32_t index, EntryData data);
+
+    void Clear();
+
+    EntryCacheStats GetStats();
+
+    size_t GetBudget() const { return this->_shardBudget * this->_shards.size(); }
+
+private:
+    std::vector<std::unique_ptr<Shard>> _shards;
+    size_t _shardBudget = 0;
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+    std::atomic<uint64_t> _evictions{0};
+};
+
+#endif // NEXAS_ENTRY_CACHE_H
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief XXH64，结果和xxHash的XXH64一致
+ *
+ * 支持一次性计算和分段Update，分段的结果和一次性计算相同
+ */
+class XXHash64
+{
+private:
+    static const uint64_t Prime1 = 0x9E3779B185EBCA87ULL;
+    static const uint64_t Prime2 = 0xC2B2AE3D27D4EB4FULL;
+    static const uint64_t Prime3 = 0x165667B19E3779F9ULL;
+    static const uint64_t Prime4 = 0x85EBCA77C2B2AE63ULL;
+    static const uint64_t Prime5 = 0x27D4EB2F165667C5ULL;
+
+    static uint64_t Rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t Read64(const uint8_t *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    static uint32_t Read32(const uint8_t *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static uint64_t Round(uint64_t acc, uint64_t input)
+    {
+        acc += input * Prime2;
+        acc = Rotl(acc, 31);
+        return acc * Prime1;
+    }
+
+    static uint64_t MergeRound(uint64_t acc, uint64_t val)
+    {
+        acc ^= Round(0, val);
+        return acc * Prime1 + Prime4;
+    }
+
+public:
+    explicit XXHash64(uint64_t seed = 0) { this->Reset(seed); }
+
+    void Reset(uint64_t seed = 0)
+    {
+        this->_v[0] = seed + Prime1 + Prime2;
+        this->_v[1] = seed + Prime2;
+        this->_v[2] = seed;
+        this->_v[3] = seed - Prime1;
+        this->_seed = seed;
+        this->_totalSize = 0;
+        this->_bufferSize = 0;
+    }
+
+    void Update(const void *data, size_t size)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        const uint8_t *const end = p + size;
+
+        this->_totalSize += size;
+
+        // 先补满上次剩下的32字节块
+        if (this->_bufferSize + size < 32)
+        {
+            if (size) memcpy(this->_buffer + this->_bufferSize, p, size);
+            this->_bufferSize += (uint32_t)size;
+            return;
+        }
+
+        if (this->_bufferSize)
+        {
+            uint32_t fill = 32 - this->_bufferSize;
+            memcpy(this->_buffer + this->_bufferSize, p, fill);
+            p += fill;
+
+            for (int i = 0; i < 4; i++) this->_v[i] = Round(this->_v[i], Read64(this->_buffer + i * 8));
+
+            this->_bufferSize = 0;
+        }
+
+        while (end - p >= 32)
+        {
+            for (int i = 0; i < 4; i++) this->_v[i] = Round(this->_v[i], Read64(p + i * 8));
+            p += 32;
+        }
+
+        if (p < end)
+        {
+            memcpy(this->_buffer, p, end - p);
+            this->_bufferSize = (uint32_t)(end - p);
+        }
+    }
+
+    uint64_t Digest() const
+    {
+        uint64_t h;
+
+        if (this->_totalSize >= 32)
+        {
+            h = Rotl(this->_v[0], 1) + Rotl(this->_v[1], 7) + Rotl(this->_v[2], 12) + Rotl(this->_v[3], 18);
+
+            for (int i = 0; i < 4; i++) h = MergeRound(h, this->_v[i]);
+        }
+        else
+        {
+            h = this->_seed + Prime5;
+        }
+
+        h += this->_totalSize;
+
+        const uint8_t *p = this->_buffer;
+        const uint8_t *const end = p + this->_bufferSize;
+
+        while (end - p >= 8)
+        {
+            h ^= Round(0, Read64(p));
+            h = Rotl(h, 27) * Prime1 + Prime4;
+            p += 8;
+        }
+
+        if (end - p >= 4)
+        {
+            h ^= (uint64_t)Read32(p) * Prime1;
+            h = Rotl(h, 23) * Prime2 + Prime3;
+            p += 4;
+        }
+
+        while (p < end)
+        {
+            h ^= (*p) * Prime5;
+            h = Rotl(h, 11) * Prime1;
+            p++;
+        }
+
+        h ^= h >> 33;
+        h *= Prime2;
+        h ^= h >> 29;
+        h *= Prime3;
+        h ^= h >> 32;
+
+        return h;
+    }
+
+    static uint64_t Compute(const void *data, size_t size, uint64_t seed = 0)
+    {
+        XXHash64 hash(seed);
+        hash.Update(data, size);
+        return hash.Digest();
+    }
+
+    /**
+     * @brief 用xxHash自带的sanity test数据检查实现是否正确
+     *
+     * 数据是2654435761为种子不断乘11400714785074694797生成的字节序列，覆盖空输入、小于32字节、大于等于32字节和带seed的情况，
+     * 同时按不同的分段大小Update，检查分段结果和一次性计算相同
+     *
+     * @return 所有结果都和xxHash一致时返回true
+     */
+    static bool SelfTest()
+    {
+        struct TestVector
+        {
+            uint32_t Size;
+            uint64_t Seed;
+            uint64_t Hash;
+        };
+
+        static const TestVector vectors[] = {
+            { 0, 0, 0xEF46DB3751D8E999ULL },   { 0, 2654435761U, 0xAC75FDA2929B17EFULL },
+            { 1, 0, 0xE934A84ADB052768ULL },   { 1, 2654435761U, 0x5014607643A9B4C3ULL },
+            { 4, 0, 0x9136A0DCA57457EEULL },   { 8, 0, 0xCDBCF538E71D1348ULL },
+            { 14, 0, 0x8282DCC4994E35C8ULL },  { 14, 2654435761U, 0xC3BD6BF63DEB6DF0ULL },
+            { 31, 0, 0x299B39A290E6D783ULL },  { 32, 0, 0x18B216492BB44B70ULL },
+            { 33, 0, 0x55C8DC3E578F5B59ULL },  { 222, 0, 0xB641AE8CB691C174ULL },
+            { 222, 2654435761U, 0x20CB8AB7AE10C14AULL },
+        };
+
+        uint8_t data[222];
+        uint64_t generator = 2654435761U;
+
+        for (uint8_t &b : data)
+        {
+            b = (uint8_t)(generator >> 56);
+            generator *= 11400714785074694797ULL;
+        }
+
+        for (const auto &vector : vectors)
+        {
+            if (Compute(data, vector.Size, vector.Seed) != vector.Hash) return false;
+
+            for (uint32_t step = 1; step <= 33; step += 4)
+            {
+                XXHash64 hash(vector.Seed);
+
+                for (uint32_t offset = 0; offset < vector.Size; offset += step)
+                {
+                    hash.Update(data + offset, vector.Size - offset < step ? vector.Size - offset : step);
+                }
+
+                if (hash.Digest() != vector.Hash) return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    uint64_t _v[4];
+    uint64_t _seed = 0;
+    uint64_t _totalSize = 0;
+    uint8_t _buffer[32];
+    uint32_t _bufferSize = 0;
+};
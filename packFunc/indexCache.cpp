@@ -0,0 +1,297 @@
+#include "indexCache.h"
+
+#include "hash.hpp"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstring>
+
+#undef min
+#undef max
+
+// .idx文件格式: IndexCacheHeader + PackageEntry[EntryCount] + uint32_t[BucketCount]
+// 所有字段都是自然对齐的，映射之后直接使用
+struct IndexCacheHeader
+{
+    uint8_t       Magic[4];
+    uint32_t      Version;
+    PackageStamp  Stamp;            // 封包的size、修改时间和末尾TailSize字节的XXH64
+    uint32_t      CompressionMethod;
+    uint32_t      EntryCount;
+    uint32_t      BucketCount;      // 文件名hash表的大小，2的幂，空位为EmptyBucket
+    uint32_t      Reserved;
+};
+
+static_assert(sizeof(IndexCacheHeader) == 0x30, "The size of IndexCacheHeader must be 30");
+
+static const uint8_t IndexCacheMagic[] = {0x50, 0x49, 0x44, 0x58}; // PIDX
+static const uint32_t IndexCacheVersion = 1;
+static const uint32_t TailSize = 4096;
+static const uint32_t EmptyBucket = UINT32_MAX;
+
+/**
+ * @brief 获取封包的size、修改时间和末尾数据的hash
+ *
+ * 只读取末尾TailSize字节，不读取和解码整个索引
+ *
+ * @param pacPath 封包文件路径，分卷时为这个分卷
+ * @param[out] stamp 封包的标记
+ * @return 函数执行结果
+ */
+bool GetPackageStamp(const std::string &pacPath, PackageStamp &stamp)
+{
+    HANDLE file = CreateFileA(pacPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    FILETIME modifyTime;
+
+    bool result = GetFileSizeEx(file, &fileSize) && GetFileTime(file, NULL, NULL, &modifyTime);
+
+    if (result)
+    {
+        uint8_t tail[TailSize];
+        uint32_t tailSize = (uint32_t)std::min<uint64_t>(fileSize.QuadPart, TailSize);
+        uint64_t offset = fileSize.QuadPart - tailSize;
+
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        DWORD readSize = 0;
+
+        result = ReadFile(file, tail, tailSize, &readSize, &overlapped) && readSize == tailSize;
+
+        stamp.PackageSize = fileSize.QuadPart;
+        stamp.ModifyTime = ((int64_t)modifyTime.dwHighDateTime << 32) | modifyTime.dwLowDateTime;
+        stamp.TailHash = XXHash64::Compute(tail, tailSize);
+    }
+
+    CloseHandle(file);
+
+    return result;
+}
+
+static uint64_t HashName(const char *name, size_t length)
+{
+    return XXHash64::Compute(name, length);
+}
+
+static bool IsSameName(const PackageEntry &entry, const char *name, size_t length)
+{
+    return strnlen(entry.Name, sizeof(entry.Name)) == length && memcmp(entry.Name, name, length) == 0;
+}
+
+IndexCache::~IndexCache()
+{
+    this->Close();
+}
+
+/**
+ * @brief 映射封包旁边的.idx
+ *
+ * @param pacPath 封包文件路径，分卷时为这个分卷
+ * @return 没有.idx、格式不对或者和封包对不上时返回false
+ */
+bool IndexCache::Open(const std::string &pacPath)
+{
+    this->Close();
+
+    HANDLE file = CreateFileA(GetIndexCachePath(pacPath).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(file, &fileSize) || (uint64_t)fileSize.QuadPart < sizeof(IndexCacheHeader))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+    // 映射的视图保持文件打开，不需要保留句柄
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+
+    if (!view) return false;
+
+    auto header = static_cast<const IndexCacheHeader *>(view);
+
+    uint64_t expectedSize = sizeof(IndexCacheHeader) + (uint64_t)header->EntryCount * sizeof(PackageEntry) + (uint64_t)header->BucketCount * 4;
+
+    PackageStamp stamp;
+
+    if (memcmp(header->Magic, IndexCacheMagic, 4) != 0 || header->Version != IndexCacheVersion || header->BucketCount == 0 ||
+        (header->BucketCount & (header->BucketCount - 1)) != 0 || expectedSize != (uint64_t)fileSize.QuadPart ||
+        !GetPackageStamp(pacPath, stamp) || !(stamp == header->Stamp))
+    {
+        UnmapViewOfFile(view);
+        return false;
+    }
+
+    auto entries = reinterpret_cast<const PackageEntry *>(header + 1);
+
+    this->_view = view;
+    this->_entries = entries;
+    this->_buckets = reinterpret_cast<const uint32_t *>(entries + header->EntryCount);
+    this->_bucketMask = header->BucketCount - 1;
+    this->_compressionMethod = header->CompressionMethod;
+    this->_entryCount = header->EntryCount;
+
+    return true;
+}
+
+void IndexCache::Close()
+{
+    if (!this->_view) return;
+
+    UnmapViewOfFile(this->_view);
+
+    this->_view = nullptr;
+    this->_entries = nullptr;
+    this->_buckets = nullptr;
+    this->_bucketMask = 0;
+    this->_compressionMethod = 0;
+    this->_entryCount = 0;
+}
+
+/**
+ * @brief 在文件名hash表里查找
+ *
+ * @param name 文件名，编码和封包内的一致
+ * @param length 文件名的长度
+ * @return 文件的index，找不到返回npos
+ */
+uint32_t IndexCache::Find(const char *name, size_t length) const
+{
+    if (!this->_view) return npos;
+
+    uint64_t hash = HashName(name, length);
+
+    // 线性探测，最多检查整个表一次
+    for (uint32_t probe = 0; probe <= this->_bucketMask; probe++)
+    {
+        uint32_t index = this->_buckets[(hash + probe) & this->_bucketMask];
+
+        if (index == EmptyBucket || index >= this->_entryCount) return npos;
+
+        if (IsSameName(this->_entries[index], name, length)) return index;
+    }
+
+    return npos;
+}
+
+/**
+ * @brief 为封包写入.idx，先写临时文件再替换，不影响正在使用旧.idx的进程
+ *
+ * @param pacPath 封包文件路径，分卷时为这个分卷，必须已经写完
+ * @param compressionMethod 封包压缩方式
+ * @param entries 这个封包的文件索引
+ * @return 函数执行结果
+ */
+bool IndexCache::Write(const std::string &pacPath, uint32_t compressionMethod, const std::vector<PackageEntry> &entries)
+{
+    IndexCacheHeader header = {};
+
+    if (!GetPackageStamp(pacPath, header.Stamp)) return false;
+
+    uint32_t count = entries.size();
+
+    // 装载率不超过一半，探测的长度很短
+    uint32_t bucketCount = 2;
+
+    while (bucketCount < (uint64_t)count * 2) bucketCount <<= 1;
+
+    std::vector<uint32_t> buckets(bucketCount, EmptyBucket);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const auto &entry = entries[i];
+
+        size_t length = strnlen(entry.Name, sizeof(entry.Name));
+        uint64_t hash = HashName(entry.Name, length);
+
+        // 重名的文件以第一个为准
+        for (uint32_t probe = 0;; probe++)
+        {
+            uint32_t &bucket = buckets[(hash + probe) & (bucketCount - 1)];
+
+            if (bucket == EmptyBucket)
+            {
+                bucket = i;
+                break;
+            }
+
+            if (IsSameName(entries[bucket], entry.Name, length)) break;
+        }
+    }
+
+    memcpy(header.Magic, IndexCacheMagic, 4);
+    header.Version = IndexCacheVersion;
+    header.CompressionMethod = compressionMethod;
+    header.EntryCount = count;
+    header.BucketCount = bucketCount;
+
+    auto path = GetIndexCachePath(pacPath);
+    auto tempPath = path + ".tmp";
+
+    FILE *fp = fopen(tempPath.c_str(), "wb");
+
+    if (!fp) return false;
+
+    bool result = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+    if (result && count > 0) result = fwrite(entries.data(), sizeof(PackageEntry) * count, 1, fp) == 1;
+    if (result) result = fwrite(buckets.data(), 4 * bucketCount, 1, fp) == 1;
+
+    if (fclose(fp) != 0) result = false;
+
+    if (result) result = MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+
+    if (!result) DeleteFileA(tempPath.c_str());
+
+    return result;
+}
+
+/**
+ * @brief 为已有的封包的所有分卷生成.idx
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @return 函数执行结果
+ */
+bool BuildIndexCache(const std::string &pacPath)
+{
+    for (const auto &volumePath : FindVolumePaths(pacPath))
+    {
+        FILE *fp = fopen(volumePath.c_str(), "rb");
+
+        if (!fp)
+        {
+            printf("ERROR: Failed to open package file.");
+            return false;
+        }
+
+        uint32_t compressionMethod;
+        std::vector<PackageEntry> entries;
+
+        bool result = ReadPackageIndex(fp, compressionMethod, entries);
+
+        fclose(fp);
+
+        if (!result) return false;
+
+        if (!IndexCache::Write(volumePath, compressionMethod, entries))
+        {
+            printf("ERROR: Failed to write index cache '%s'.", GetIndexCachePath(volumePath).c_str());
+            return false;
+        }
+
+        printf("Wrote index cache '%s' (%u files).\n", GetIndexCachePath(volumePath).c_str(), (uint32_t)entries.size());
+    }
+
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef NEXAS_INDEX_CACHE_H
+#define NEXAS_INDEX_CACHE_H
+
+#include "packFunc.h"
+
+/**
+ * @brief 封包的size、修改时间和末尾数据的hash，封包改变之后就对不上
+ */
+struct PackageStamp
+{
+    uint64_t      PackageSize;
+    int64_t       ModifyTime;       // FILETIME
+    uint64_t      TailHash;         // 封包末尾4KB的XXH64，包括加密的索引和索引size
+
+    bool operator==(const PackageStamp &other) const
+    {
+        return this->PackageSize == other.PackageSize && this->ModifyTime == other.ModifyTime && this->TailHash == other.TailHash;
+    }
+};
+
+static_assert(sizeof(PackageStamp) == 0x18, "The size of PackageStamp must be 18");
+
+bool GetPackageStamp(const std::string &pacPath, PackageStamp &stamp);
+
+/**
+ * @brief 封包旁边的.idx索引缓存
+ *
+ * 保存解码后的文件索引和预先建立的文件名hash表，布局固定，映射之后直接使用，
+ * 打开封包时不需要读取和解码Huffman压缩的索引
+ *
+ * 记录了封包的size、修改时间和末尾数据的hash，封包改变之后.idx自动失效
+ */
+class IndexCache
+{
+public:
+    static const uint32_t npos = UINT32_MAX;
+
+    IndexCache() = default;
+
+    ~IndexCache();
+
+    IndexCache(const IndexCache &) = delete;
+
+    IndexCache &operator=(const IndexCache &) = delete;
+
+    bool Open(const std::string &pacPath);
+
+    void Close();
+
+    bool IsOpen() const { return _view != nullptr; }
+
+    uint32_t GetCompressionMethod() const { return _compressionMethod; }
+
+    uint32_t GetEntryCount() const { return _entryCount; }
+
+    const PackageEntry *GetEntries() const { return _entries; }
+
+    uint32_t Find(const char *name, size_t length) const;
+
+    static bool Write(const std::string &pacPath, uint32_t compressionMethod, const std::vector<PackageEntry> &entries);
+
+private:
+    const void *_view = nullptr;            // 映射的.idx
+    const PackageEntry *_entries = nullptr;
+    const uint32_t *_buckets = nullptr;     // 文件名hash表，保存文件index
+    uint32_t _bucketMask = 0;
+    uint32_t _compressionMethod = 0;
+    uint32_t _entryCount = 0;
+};
+
+inline std::string GetIndexCachePath(const std::string &pacPath)
+{
+    return pacPath + ".idx";
+}
+
+#endif // NEXAS_INDEX_CACHE_H
@@ -0,0 +1,147 @@
+#include "layout.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <unordered_map>
+
+/**
+ * @brief 转换成小写，封包内的文件名不区分大小写
+ */
+static std::string ToLower(std::string text)
+{
+    for (auto &c : text) c = (char)tolower((unsigned char)c);
+
+    return text;
+}
+
+/**
+ * @brief 获取小写的扩展名，没有扩展名时返回空
+ */
+static std::string GetExtension(const std::string &name)
+{
+    auto dot = name.find_last_of('.');
+
+    return dot == std::string::npos ? std::string() : ToLower(name.substr(dot));
+}
+
+/**
+ * @brief 读取访问记录
+ *
+ * @param tracePath 访问记录文件路径
+ * @param traceOrder 输出小写的文件名和第一次出现的顺序
+ * @return 文件不存在返回false
+ */
+static bool ReadAccessTrace(const std::string &tracePath, std::unordered_map<std::string, uint32_t> &traceOrder)
+{
+    FILE *fp = fopen(tracePath.c_str(), "rb");
+
+    if (!fp)
+    {
+        printf("ERROR: Failed to open access trace '%s'.\n", tracePath.c_str());
+        return false;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t readSize;
+
+    while ((readSize = fread(buffer, 1, sizeof(buffer), fp)) > 0) text.append(buffer, readSize);
+
+    fclose(fp);
+
+    size_t start = 0;
+
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+
+        if (end == std::string::npos) end = text.size();
+
+        std::string line = text.substr(start, end - start);
+        start = end + 1;
+
+        while (!line.empty() && isspace((unsigned char)line.back())) line.pop_back();
+
+        if (line.empty() || line[0] == '#') continue;
+
+        // 记录里带路径时只取文件名
+        auto separator = line.find_last_of("\\/");
+
+        if (separator != std::string::npos) line.erase(0, separator + 1);
+
+        traceOrder.emplace(ToLower(line), (uint32_t)traceOrder.size());
+    }
+
+    return true;
+}
+
+bool ApplyAccessLayout(const std::string &tracePath, std::vector<PackItem> &items, std::vector<std::string> &names)
+{
+    std::unordered_map<std::string, uint32_t> traceOrder;
+
+    if (!ReadAccessTrace(tracePath, traceOrder)) return false;
+
+    // 每个文件的排序key，记录里的文件用记录里的顺序，其余的用扩展名
+    struct LayoutKey
+    {
+        bool Traced;
+        uint32_t Order;
+        std::string Extension;
+    };
+
+    std::vector<LayoutKey> keys(items.size());
+    std::vector<bool> matched(traceOrder.size(), false);
+    uint32_t tracedCount = 0;
+
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        auto found = traceOrder.find(ToLower(names[i]));
+
+        if (found != traceOrder.end())
+        {
+            keys[i] = {true, found->second, std::string()};
+            matched[found->second] = true;
+            tracedCount++;
+        }
+        else
+        {
+            keys[i] = {false, 0, GetExtension(names[i])};
+        }
+    }
+
+    std::vector<size_t> order(items.size());
+
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b)
+                     {
+                         const auto &keyA = keys[a];
+                         const auto &keyB = keys[b];
+
+                         if (keyA.Traced != keyB.Traced) return keyA.Traced;
+                         if (keyA.Traced) return keyA.Order < keyB.Order;
+                         return keyA.Extension < keyB.Extension;
+                     });
+
+    std::vector<PackItem> sortedItems;
+    std::vector<std::string> sortedNames;
+    sortedItems.reserve(items.size());
+    sortedNames.reserve(names.size());
+
+    for (size_t i : order)
+    {
+        sortedItems.emplace_back(std::move(items[i]));
+        sortedNames.emplace_back(std::move(names[i]));
+    }
+
+    items.swap(sortedItems);
+    names.swap(sortedNames);
+
+    uint32_t missingCount = (uint32_t)std::count(matched.begin(), matched.end(), false);
+
+    printf("Layout: %u files in trace order, %u grouped by extension, %u traced names not in package.\n", tracedCount,
+           (uint32_t)items.size() - tracedCount, missingCount);
+
+    return true;
+}
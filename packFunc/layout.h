@@ -0,0 +1,20 @@
+#ifndef NEXAS_LAYOUT_H
+#define NEXAS_LAYOUT_H
+
+#include "manifest.h"
+
+/**
+ * @brief 按访问记录重新排列写入顺序
+ *
+ * 访问记录每行一个文件名，按游戏读取的顺序排列，空行和#开头的行忽略，带路径时只取文件名。
+ * 记录里的文件按第一次出现的顺序写在前面，这样同一个场景读取的文件在封包里是连续的；
+ * 其余文件按扩展名分组写在后面，组内保持原来的顺序
+ *
+ * @param tracePath 访问记录文件路径
+ * @param items 要写入的文件，按新的顺序重新排列
+ * @param names 每个文件在封包内的文件名，和items一一对应，同样重新排列
+ * @return 访问记录不存在返回false
+ */
+bool ApplyAccessLayout(const std::string &tracePath, std::vector<PackItem> &items, std::vector<std::string> &names);
+
+#endif // NEXAS_LAYOUT_H
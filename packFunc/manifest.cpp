@@ -0,0 +1,143 @@
+#include "manifest.h"
+#include "packFunc.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * @brief 按分隔符拆分一行
+ */
+static std::vector<std::string> SplitLine(const std::string &line, char separator)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+
+    while (true)
+    {
+        size_t end = line.find(separator, start);
+
+        if (end == std::string::npos)
+        {
+            fields.emplace_back(line.substr(start));
+            break;
+        }
+
+        fields.emplace_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+
+    return fields;
+}
+
+/**
+ * @brief 解析压缩方式字段
+ *
+ * @return 字段不合法返回false
+ */
+static bool ParseEntryMethod(const std::string &field, uint32_t compressionMethod, unsigned lineNumber, EntryMethod &method)
+{
+    if (field.empty() || _stricmp(field.c_str(), "auto") == 0)
+        method = EntryMethod::Auto;
+    else if (_stricmp(field.c_str(), "store") == 0)
+        method = EntryMethod::Store;
+    else if (_stricmp(field.c_str(), "compress") == 0)
+        method = EntryMethod::Compress;
+    else if (_stricmp(field.c_str(), "zlib") == 0 || _stricmp(field.c_str(), "zstd") == 0)
+    {
+        // 封包只有一个压缩方式，不同的压缩方式只能按封包的压缩
+        if (_stricmp(field.c_str(), GetCompressionName(compressionMethod)) != 0)
+        {
+            printf("WARNING: Manifest line %u: package uses %s compression, '%s' is ignored.\n", lineNumber, GetCompressionName(compressionMethod), field.c_str());
+        }
+
+        method = EntryMethod::Compress;
+    }
+    else
+    {
+        printf("ERROR: Manifest line %u: unknown method '%s'.\n", lineNumber, field.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ReadManifest(const std::string &path, uint32_t compressionMethod, std::vector<PackItem> &items)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp)
+    {
+        printf("ERROR: Failed to open manifest '%s'.\n", path.c_str());
+        return false;
+    }
+
+    std::string text;
+    char buffer[4096];
+    size_t readSize;
+
+    while ((readSize = fread(buffer, 1, sizeof(buffer), fp)) > 0) text.append(buffer, readSize);
+
+    fclose(fp);
+
+    // 跳过UTF-8 BOM
+    if (text.size() >= 3 && memcmp(text.data(), "\xEF\xBB\xBF", 3) == 0) text.erase(0, 3);
+
+    auto lines = SplitLine(text, '\n');
+    unsigned lineNumber = 0;
+
+    for (auto &line : lines)
+    {
+        lineNumber++;
+
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        if (line.empty() || line[0] == '#') continue;
+
+        auto fields = SplitLine(line, '\t');
+
+        if (fields.size() > 4 || fields[0].empty())
+        {
+            printf("ERROR: Manifest line %u: expected 'path[\\tname[\\tmethod[\\tlevel]]]'.\n", lineNumber);
+            return false;
+        }
+
+        PackItem item;
+        item.File.Path = fields[0];
+
+        if (fields.size() > 1) item.Name = fields[1];
+
+        if (fields.size() > 2 && !ParseEntryMethod(fields[2], compressionMethod, lineNumber, item.Method)) return false;
+
+        if (fields.size() > 3 && !fields[3].empty())
+        {
+            char *end = nullptr;
+            item.Level = (int)strtol(fields[3].c_str(), &end, 10);
+
+            if (*end != '\0')
+            {
+                printf("ERROR: Manifest line %u: invalid level '%s'.\n", lineNumber, fields[3].c_str());
+                return false;
+            }
+
+            item.HasLevel = true;
+        }
+
+        // 和遍历文件夹一样在这里取得size和修改时间
+        struct _stat64 fileStat = {};
+
+        if (_stat64(item.File.Path.c_str(), &fileStat) != 0 || (fileStat.st_mode & S_IFDIR))
+        {
+            printf("ERROR: Manifest line %u: can't find file '%s'.\n", lineNumber, item.File.Path.c_str());
+            return false;
+        }
+
+        item.File.Size = (uint64_t)fileStat.st_size;
+        item.File.ModifyTime = (int64_t)fileStat.st_mtime;
+
+        items.emplace_back(std::move(item));
+    }
+
+    return true;
+}
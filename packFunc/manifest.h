@@ -0,0 +1,44 @@
+#ifndef NEXAS_MANIFEST_H
+#define NEXAS_MANIFEST_H
+
+#include "dirScanner.h"
+
+/**
+ * @brief 单个文件的压缩方式
+ *
+ * 封包只有一个压缩方式，所以单个文件只能选择存储或者用封包的压缩方式压缩
+ */
+enum class EntryMethod
+{
+    Auto,       // 抽样判断是否压缩
+    Store,      // 总是直接存储
+    Compress    // 总是压缩，压缩后没有变小仍然存储
+};
+
+/**
+ * @brief 要写入封包的一个文件
+ */
+struct PackItem
+{
+    ScannedFile File;
+    std::string Name;                       // 封包内的文件名，为空时使用文件名
+    EntryMethod Method = EntryMethod::Auto;
+    bool HasLevel = false;                  // 是否指定了压缩等级
+    int Level = 0;
+};
+
+/**
+ * @brief 读取封包清单
+ *
+ * 每行一个文件: 路径[\t封包内文件名[\t压缩方式[\t压缩等级]]]，空行和#开头的行忽略。
+ * 压缩方式为auto、store、compress，或者和封包相同的zlib/zstd，省略的字段可以留空。
+ * 清单的顺序就是写入封包的顺序
+ *
+ * @param path 清单文件路径
+ * @param compressionMethod 封包压缩方式
+ * @param items 输出要写入的文件
+ * @return 清单不存在、格式不对或者文件不存在都返回false
+ */
+bool ReadManifest(const std::string &path, uint32_t compressionMethod, std::vector<PackItem> &items);
+
+#endif // NEXAS_MANIFEST_H
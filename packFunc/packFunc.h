@@ -1,6 +1,8 @@
 #ifndef NEXAS_PACKFUNC
 #define NEXAS_PACKFUNC
 
+#include <cstdio>
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -14,8 +16,79 @@ struct PackageEntry
 
 static_assert(sizeof(PackageEntry) == 0x4C, "The size of PackageEntry must be 4C");
 
+// 分卷标记，紧跟在每个分卷的文件头后面，不属于任何文件的数据，读取时只合并标记对得上的分卷
+struct VolumeTag
+{
+    uint8_t       Magic[4];
+    uint32_t      PackageId;    // 同一个封包的所有分卷相同
+    uint32_t      Volume;       // 卷号
+    uint32_t      VolumeCount;  // 分卷数量，写入索引之前为0
+};
+
+static_assert(sizeof(VolumeTag) == 0x10, "The size of VolumeTag must be 10");
+
+// 读写方式，Async使用完成端口和重叠I/O，读写和压缩解压同时进行
+enum class IoMode
+{
+    Sync,
+    Async
+};
+
+struct PackOptions
+{
+    std::string BasePath;       // 增量封包的基准封包，未改变的文件直接复制压缩数据
+    bool BaseHash = false;      // 不信任修改时间，总是比较hash
+    bool WriteChecksum = false; // 输出.sum文件，指定BasePath时总是输出
+    std::string CacheDir;       // 压缩结果缓存目录，为空时不使用缓存
+    uint64_t CacheSize = 4ULL << 30;    // 缓存目录的size上限
+    bool Dedup = false;         // 内容相同的文件只写入一份数据，索引指向同一位置
+    double StoreEntropy = 7.9;  // 抽样的字节熵(bit/字节)不低于这个值时直接存储
+    double StoreRatio = 0.97;   // 试压缩后的size不低于原始size的这个比例时直接存储
+    std::vector<std::string> StoreExtensions;   // 总是直接存储的扩展名，小写并且带'.'
+    std::string LayoutPath;     // 访问记录，记录里的文件按记录的顺序写在前面，其余的按扩展名分组
+    uint32_t Align = 0;         // 每个文件数据的起始位置对齐到这个值，0和1表示不对齐
+    uint64_t VolumeSize = UINT32_MAX;   // 单个分卷的size上限，超过时自动分卷，不能超过4GB
+    bool Unordered = false;     // 各线程压缩完直接写入，数据的排列顺序不固定，不能和去重、分卷同时使用
+    bool SortIndex = false;     // 索引按文件名排序
+    uint64_t StreamSize = 256ULL << 20; // 不小于这个size的文件不读进内存，写入时分块压缩
+    IoMode Io = IoMode::Sync;   // 封包的写入方式
+    bool WriteIndexCache = false;   // 输出每个分卷的.idx，打开封包时直接映射，不解码索引
+    bool HasLevel = false;      // 是否指定了压缩等级，清单里指定的等级优先
+    int Level = 0;
+};
+
+struct ExtractOptions
+{
+    bool VerifyOnly = false;    // 只解压校验，不写出文件
+    uint64_t StreamSize = 64ULL << 20;  // 解压后不小于这个size的文件分块解压，直接写到输出文件
+    uint64_t MapSize = 4ULL << 20;      // 解压后不小于这个size的文件直接解压到映射的输出文件
+    IoMode Io = IoMode::Sync;   // 封包的读取方式
+    bool SkipUnchanged = false; // 输出文件已经存在并且内容相同时不写出
+    const uint64_t *Hashes = nullptr;   // 和文件索引一一对应的原始数据hash，来自标记和封包一致的.sum，用来校验和比较输出文件
+    const uint64_t *CompressedHashes = nullptr; // 和文件索引一一对应的封包数据hash，来自.sum，用来校验读取的数据
+};
+
+enum class ListFormat
+{
+    Text,
+    Csv,
+    Json
+};
+
 bool CreatePackage(const std::string& pacPath, const std::string& dirPath, int compressionMethod,int codePage);
-bool CreatePackageMT(const std::string& pacPath, const std::string& dirPath, int compressionMethod,int codePage);
-bool ExtractPackage(const std::string& pacPath, const std::string& dirPath,int codePage);
+bool CreatePackageMT(const std::string& pacPath, const std::string& dirPath, int compressionMethod,int codePage, const PackOptions& options = PackOptions());
+bool TranscodePackage(const std::string& srcPath, const std::string& pacPath, int compressionMethod, const PackOptions& options = PackOptions());
+bool ExtractPackage(const std::string& pacPath, const std::string& dirPath,int codePage, const ExtractOptions& options = ExtractOptions());
+bool VerifyPackage(const std::string& pacPath, const ExtractOptions& options = ExtractOptions());
+bool BenchmarkPackage(const std::string& pacPath, uint32_t runs);
+bool ReadPackageIndex(FILE* fp, uint32_t& compressionMethod, std::vector<PackageEntry>& entries);
+bool LoadPackageIndex(const std::string& path, uint32_t& compressionMethod, std::vector<PackageEntry>& entries);
+bool BuildIndexCache(const std::string& pacPath);
+bool ListPackage(const std::string& pacPath, ListFormat format, int codePage);
+const char* GetCompressionName(uint32_t compressionMethod);
+std::string GetVolumePath(const std::string& pacPath, uint32_t volume);
+std::vector<std::string> FindVolumePaths(const std::string& pacPath);
+VolumeTag MakeVolumeTag(uint32_t packageId, uint32_t volume);
+bool ReadVolumeTag(const std::string& path, VolumeTag& tag);
 
 #endif
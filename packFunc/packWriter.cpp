@@ -0,0 +1,383 @@
+#include "packWriter.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#undef min
+#undef max
+
+PackWriter::~PackWriter()
+{
+    this->Close();
+}
+
+/**
+ * @brief 打开输出文件
+ *
+ * @param path 文件路径
+ * @param append 为true时打开已经存在的文件，在末尾追加；否则创建新文件，已经存在时覆盖
+ * @param bufferSize 缓冲区size
+ * @return 函数执行结果
+ */
+bool PackWriter::Open(const std::string &path, bool append, size_t bufferSize)
+{
+    this->Close();
+
+    DWORD flags = FILE_FLAG_SEQUENTIAL_SCAN | (this->_async ? FILE_FLAG_OVERLAPPED : 0);
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, append ? OPEN_EXISTING : CREATE_ALWAYS, flags, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        printf("ERROR: Failed to open package file '%s' for writing.\n", path.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize = {};
+
+    if (append) GetFileSizeEx(file, &fileSize);
+
+    // VirtualAlloc分配的内存按页对齐
+    this->_buffer = (uint8_t *)VirtualAlloc(NULL, bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+    if (this->_async)
+    {
+        this->_spareBuffer = (uint8_t *)VirtualAlloc(NULL, bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+
+        auto overlapped = new OVERLAPPED();
+        overlapped->hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        this->_pendingWrite = overlapped;
+    }
+
+    if (!this->_buffer || (this->_async && !this->_spareBuffer))
+    {
+        printf("ERROR: Failed to allocate %zu bytes for the write buffer.\n", bufferSize);
+        CloseHandle(file);
+        this->Close();      // 释放已经分配的缓冲区
+        return false;
+    }
+
+    this->_path = path;
+    this->_file = file;
+    this->_bufferSize = bufferSize;
+    this->_bufferUsed = 0;
+    this->_offset = (uint64_t)fileSize.QuadPart;
+    this->_flushedOffset = this->_offset;
+    this->_writeCount = 0;
+    this->_failed = false;
+
+    return true;
+}
+
+/**
+ * @brief 写出缓冲区并关闭文件
+ *
+ * @return 所有写入都成功返回true
+ */
+bool PackWriter::Close()
+{
+    if (this->_file)
+    {
+        bool flushed = this->Flush();
+
+        // 关闭之前必须等异步写出完成，出错时也一样
+        flushed = this->WaitPending() && flushed;
+
+        // 退回去重新写入的数据可能比原来的短，文件size以最后写入的位置为准
+        if (flushed)
+        {
+            FILE_END_OF_FILE_INFO endOfFile;
+            endOfFile.EndOfFile.QuadPart = (LONGLONG)this->_offset.load();
+
+            SetFileInformationByHandle((HANDLE)this->_file, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile));
+        }
+
+        CloseHandle((HANDLE)this->_file);
+    }
+
+    if (this->_buffer) VirtualFree(this->_buffer, 0, MEM_RELEASE);
+    if (this->_spareBuffer) VirtualFree(this->_spareBuffer, 0, MEM_RELEASE);
+
+    if (this->_pendingWrite)
+    {
+        auto overlapped = (OVERLAPPED *)this->_pendingWrite;
+
+        if (overlapped->hEvent) CloseHandle(overlapped->hEvent);
+
+        delete overlapped;
+    }
+
+    this->_file = nullptr;
+    this->_buffer = nullptr;
+    this->_spareBuffer = nullptr;
+    this->_pendingWrite = nullptr;
+
+    return !this->_failed;
+}
+
+/**
+ * @brief 预先分配磁盘空间，减少写入过程中文件系统扩展文件的次数
+ *
+ * 只分配空间不改变文件size，多分配的空间在关闭文件时释放，失败时不影响写入
+ *
+ * @param size 预计的文件size
+ */
+void PackWriter::Preallocate(uint64_t size)
+{
+    if (!this->_file || size <= this->_offset) return;
+
+    FILE_ALLOCATION_INFO allocation;
+    allocation.AllocationSize.QuadPart = (LONGLONG)size;
+
+    SetFileInformationByHandle((HANDLE)this->_file, FileAllocationInfo, &allocation, sizeof(allocation));
+}
+
+/**
+ * @brief 在已经写入的数据后面追加
+ *
+ * @return 函数执行结果
+ */
+bool PackWriter::Write(const void *data, size_t size)
+{
+    if (!this->_file || this->_failed) return false;
+
+    // 缓冲区为空时从当前末尾开始，中间可能有预留的空间
+    if (this->_bufferUsed == 0) this->_flushedOffset = this->_offset;
+
+    if (size >= this->_bufferSize)
+    {
+        // 大块数据直接写出，避免多复制一次
+        if (!this->Flush() || !this->WriteRaw(this->_offset, data, size)) return false;
+
+        this->_offset += size;
+        this->_flushedOffset = this->_offset;
+
+        return true;
+    }
+
+    if (this->_bufferUsed + size > this->_bufferSize && !this->Flush()) return false;
+
+    memcpy(this->_buffer + this->_bufferUsed, data, size);
+
+    this->_bufferUsed += size;
+    this->_offset += size;
+
+    return true;
+}
+
+/**
+ * @brief 覆盖已经写入的数据
+ *
+ * @param offset 文件内的位置，offset + size不能超过GetOffset()
+ * @return 函数执行结果
+ */
+bool PackWriter::WriteAt(uint64_t offset, const void *data, uint32_t size)
+{
+    if (!this->_file || this->_failed || offset + size > this->_offset) return false;
+
+    // 要覆盖的位置可能正在异步写出
+    if (!this->WaitPending()) return false;
+
+    // 还在缓冲区里的部分直接改缓冲区
+    if (this->_bufferUsed > 0 && offset + size > this->_flushedOffset)
+    {
+        uint64_t start = std::max(offset, this->_flushedOffset);
+
+        memcpy(this->_buffer + (start - this->_flushedOffset), (const uint8_t *)data + (start - offset), (size_t)(offset + size - start));
+
+        if (offset >= this->_flushedOffset) return true;
+
+        size = (uint32_t)(this->_flushedOffset - offset);
+    }
+
+    return this->WriteRaw(offset, data, size);
+}
+
+/**
+ * @brief 写出缓冲区里的数据
+ *
+ * @return 函数执行结果
+ */
+bool PackWriter::Flush()
+{
+    if (!this->_file || this->_failed) return false;
+
+    if (this->_bufferUsed == 0) return true;
+
+    if (this->_async)
+    {
+        // 等上一次写出完成，再把当前缓冲区交给系统写出，之后填充另一个缓冲区
+        if (!this->WaitPending()) return false;
+
+        auto overlapped = (OVERLAPPED *)this->_pendingWrite;
+        HANDLE event = overlapped->hEvent;
+
+        *overlapped = {};
+        overlapped->Offset = (DWORD)this->_flushedOffset;
+        overlapped->OffsetHigh = (DWORD)(this->_flushedOffset >> 32);
+        overlapped->hEvent = event;
+
+        ResetEvent(event);
+
+        this->_writeCount++;
+
+        if (!WriteFile((HANDLE)this->_file, this->_buffer, (DWORD)this->_bufferUsed, NULL, overlapped) && GetLastError() != ERROR_IO_PENDING)
+        {
+            printf("ERROR: Failed to write package file '%s'.\n", this->_path.c_str());
+            this->_failed = true;
+            return false;
+        }
+
+        this->_pendingSize = this->_bufferUsed;
+        std::swap(this->_buffer, this->_spareBuffer);
+    }
+    else if (!this->WriteRaw(this->_flushedOffset, this->_buffer, this->_bufferUsed))
+    {
+        return false;
+    }
+
+    this->_flushedOffset += this->_bufferUsed;
+    this->_bufferUsed = 0;
+
+    return true;
+}
+
+/**
+ * @brief 丢弃offset之后写入的数据，之后从offset继续写入
+ *
+ * 已经写出的数据留在文件里，之后被新的数据覆盖，关闭时截断多余的部分
+ *
+ * @param offset 新的末尾位置，不能超过GetOffset()
+ * @return 函数执行结果
+ */
+bool PackWriter::Rewind(uint64_t offset)
+{
+    if (!this->_file || this->_failed || offset > this->_offset) return false;
+
+    // 之后的写入会覆盖正在异步写出的位置，必须先等它完成
+    if (!this->WaitPending()) return false;
+
+    if (this->_bufferUsed == 0) this->_flushedOffset = this->_offset;
+
+    if (offset >= this->_flushedOffset)
+    {
+        this->_bufferUsed = (size_t)(offset - this->_flushedOffset);
+    }
+    else
+    {
+        this->_bufferUsed = 0;
+        this->_flushedOffset = offset;
+    }
+
+    this->_offset = offset;
+
+    return true;
+}
+
+/**
+ * @brief 在末尾预留一段空间，可以在多个线程里同时调用
+ *
+ * 预留之前要先Flush，预留期间不能调用Write
+ *
+ * @param size 预留的size
+ * @param limit 预留之后文件size的上限
+ * @param[out] offset 预留空间的起始位置
+ * @return 超过上限时不预留，返回false
+ */
+bool PackWriter::Reserve(uint64_t size, uint64_t limit, uint64_t &offset)
+{
+    uint64_t current = this->_offset.load();
+
+    do
+    {
+        if (current + size > limit) return false;
+
+    } while (!this->_offset.compare_exchange_weak(current, current + size));
+
+    offset = current;
+
+    return true;
+}
+
+/**
+ * @brief 写入Reserve预留的空间，可以在多个线程里同时调用
+ *
+ * @return 函数执行结果
+ */
+bool PackWriter::WriteReserved(uint64_t offset, const void *data, size_t size)
+{
+    if (!this->_file || this->_failed) return false;
+
+    return this->WriteRaw(offset, data, size);
+}
+
+/**
+ * @brief 按位置写入，WriteFile的size是DWORD，大块数据分多次写入
+ */
+bool PackWriter::WriteRaw(uint64_t offset, const void *data, size_t size)
+{
+    auto current = (const uint8_t *)data;
+
+    while (size > 0)
+    {
+        DWORD chunk = (DWORD)std::min<size_t>(size, 0x40000000);
+        DWORD written = 0;
+
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        // 异步模式下可能有多个线程同时写入，每次写入用自己的事件等待完成
+        if (this->_async) overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+        this->_writeCount++;
+
+        BOOL result = WriteFile((HANDLE)this->_file, current, chunk, &written, &overlapped);
+
+        if (!result && this->_async && GetLastError() == ERROR_IO_PENDING)
+        {
+            result = GetOverlappedResult((HANDLE)this->_file, &overlapped, &written, TRUE);
+        }
+
+        if (overlapped.hEvent) CloseHandle(overlapped.hEvent);
+
+        if (!result || written != chunk)
+        {
+            printf("ERROR: Failed to write package file '%s'.\n", this->_path.c_str());
+            this->_failed = true;
+            return false;
+        }
+
+        current += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 等待异步写出完成
+ *
+ * @return 没有写出中的数据或者写出成功返回true
+ */
+bool PackWriter::WaitPending()
+{
+    if (this->_pendingSize == 0) return true;
+
+    DWORD written = 0;
+    BOOL result = GetOverlappedResult((HANDLE)this->_file, (OVERLAPPED *)this->_pendingWrite, &written, TRUE);
+
+    size_t size = this->_pendingSize;
+    this->_pendingSize = 0;
+
+    if (!result || written != size)
+    {
+        printf("ERROR: Failed to write package file '%s'.\n", this->_path.c_str());
+        this->_failed = true;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef NEXAS_PACK_WRITER_H
+#define NEXAS_PACK_WRITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief 封包输出
+ *
+ * 顺序写入的数据先放进按页对齐的大缓冲区，缓冲区满了才用WriteFile一次写出，
+ * 连续的多个小文件合并成一次系统调用；比缓冲区还大的数据不经过缓冲区直接写出。
+ * 所有写入都按位置进行，不依赖文件指针，WriteAt用来最后回去更新文件头
+ *
+ * 乱序写入时各线程用Reserve在末尾预留空间，再用WriteReserved直接写入，不经过缓冲区
+ *
+ * Rewind丢弃最后写入的数据，用来在分块压缩没有变小时退回去直接存储
+ *
+ * 异步模式下文件用FILE_FLAG_OVERLAPPED打开，使用两个缓冲区，Flush提交一个缓冲区的写出后
+ * 不等待完成，继续填充另一个缓冲区，压缩和写出同时进行
+ *
+ * 出错之后的写入都会失败，Close返回整个过程是否成功
+ */
+class PackWriter
+{
+public:
+    static const size_t DefaultBufferSize = 8 * 1024 * 1024;
+
+    explicit PackWriter(bool async = false) : _async(async) {}
+
+    ~PackWriter();
+
+    PackWriter(const PackWriter &) = delete;
+
+    PackWriter &operator=(const PackWriter &) = delete;
+
+    bool Open(const std::string &path, bool append = false, size_t bufferSize = DefaultBufferSize);
+
+    bool Close();
+
+    bool IsOpen() const { return this->_file != nullptr; }
+
+    uint64_t GetOffset() const { return this->_offset; }
+
+    uint32_t GetWriteCount() const { return this->_writeCount; }
+
+    void Preallocate(uint64_t size);
+
+    bool Write(const void *data, size_t size);
+
+    bool WriteAt(uint64_t offset, const void *data, uint32_t size);
+
+    bool Flush();
+
+    bool Rewind(uint64_t offset);
+
+    bool Reserve(uint64_t size, uint64_t limit, uint64_t &offset);
+
+    bool WriteReserved(uint64_t offset, const void *data, size_t size);
+
+private:
+    bool WriteRaw(uint64_t offset, const void *data, size_t size);
+
+    bool WaitPending();
+
+    std::string _path;
+    void *_file = nullptr;          // HANDLE
+    uint8_t *_buffer = nullptr;
+    size_t _bufferSize = 0;
+    size_t _bufferUsed = 0;
+    std::atomic<uint64_t> _offset{0};   // 已经写入的数据size，包括缓冲区里的和预留的
+    uint64_t _flushedOffset = 0;    // 缓冲区数据在文件里的起始位置
+    std::atomic<uint32_t> _writeCount{0};   // WriteFile的调用次数
+    std::atomic<bool> _failed{false};
+    bool _async = false;
+    uint8_t *_spareBuffer = nullptr;    // 异步模式下正在写出的缓冲区
+    void *_pendingWrite = nullptr;  // 异步写出的OVERLAPPED
+    size_t _pendingSize = 0;        // 异步写出中的size，为0时没有写出中的数据
+};
+
+#endif // NEXAS_PACK_WRITER_H
@@ -0,0 +1,531 @@
+#include "packageReader.h"
+
+#include "codec.h"
+#include "asyncReader.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#undef min
+#undef max
+
+PackageReader::~PackageReader()
+{
+    this->Close();
+}
+
+/**
+ * @brief 打开封包并解码索引，有分卷时打开所有分卷，有有效的.idx时不解码
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @return 函数执行结果
+ */
+bool PackageReader::Open(const std::string &pacPath)
+{
+    this->Close();
+
+    auto volumePaths = FindVolumePaths(pacPath);
+
+    for (uint32_t volume = 0; volume < volumePaths.size(); volume++)
+    {
+        const auto &volumePath = volumePaths[volume];
+
+        uint32_t compressionMethod;
+        std::vector<PackageEntry> entries;
+
+        std::unique_ptr<IndexCache> indexCache(new IndexCache());
+
+        if (indexCache->Open(volumePath))
+        {
+            compressionMethod = indexCache->GetCompressionMethod();
+            entries.assign(indexCache->GetEntries(), indexCache->GetEntries() + indexCache->GetEntryCount());
+
+            this->_indexCaches.emplace_back(std::move(indexCache));
+        }
+        else
+        {
+            FILE *fp = fopen(volumePath.c_str(), "rb");
+
+            if (!fp)
+            {
+                printf("ERROR: Failed to open package file.");
+                this->Close();
+                return false;
+            }
+
+            bool result = ReadPackageIndex(fp, compressionMethod, entries);
+
+            fclose(fp);
+
+            if (!result)
+            {
+                this->Close();
+                return false;
+            }
+        }
+
+        if (volume == 0)
+        {
+            this->_compressionMethod = compressionMethod;
+        }
+        else if (compressionMethod != this->_compressionMethod)
+        {
+            printf("ERROR: Volume '%s' uses a different compression method.\n", volumePath.c_str());
+            this->Close();
+            return false;
+        }
+
+        // 重叠I/O的句柄上多个线程的读取可以同时进行
+        HANDLE file = CreateFileA(volumePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_FLAG_RANDOM_ACCESS | FILE_FLAG_OVERLAPPED, NULL);
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            printf("ERROR: Failed to open package file.");
+            this->Close();
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+
+        this->_volumes.push_back({file, (uint64_t)fileSize.QuadPart});
+        this->_entries.insert(this->_entries.end(), entries.begin(), entries.end());
+        this->_entryVolumes.insert(this->_entryVolumes.end(), entries.size(), volume);
+    }
+
+    // 所有分卷都有.idx时直接使用其中的文件名hash表
+    if (this->_indexCaches.size() == this->_volumes.size()) return true;
+
+    this->_indexCaches.clear();
+
+    // 建立文件名索引，重名的文件以第一个为准
+    this->_nameIndex.reserve(this->_entries.size());
+
+    for (uint32_t i = 0; i < this->_entries.size(); i++)
+    {
+        const auto &entry = this->_entries[i];
+        this->_nameIndex.emplace(std::string(entry.Name, strnlen(entry.Name, sizeof(entry.Name))), i);
+    }
+
+    return true;
+}
+
+void PackageReader::Close()
+{
+    // 关闭文件之前要等预读的线程结束
+    this->WaitPrefetch();
+
+    for (const auto &volume : this->_volumes)
+    {
+        CloseHandle(volume.File);
+    }
+
+    this->_volumes.clear();
+    this->_compressionMethod = 0;
+    this->_entries.clear();
+    this->_entryVolumes.clear();
+    this->_nameIndex.clear();
+    this->_indexCaches.clear();
+
+    // index在不同的封包之间没有意义
+    if (this->_cache) this->_cache->Clear();
+}
+
+/**
+ * @brief 按文件名查找文件
+ *
+ * @param name 文件名，编码和封包内的一致
+ * @return 文件的index，找不到返回npos
+ */
+uint32_t PackageReader::Find(const std::string &name) const
+{
+    if (!this->_indexCaches.empty())
+    {
+        // 按分卷的顺序查找，重名的文件以第一个为准
+        uint32_t firstIndex = 0;
+
+        for (const auto &indexCache : this->_indexCaches)
+        {
+            uint32_t index = indexCache->Find(name.data(), name.size());
+
+            if (index != IndexCache::npos) return firstIndex + index;
+
+            firstIndex += indexCache->GetEntryCount();
+        }
+
+        return npos;
+    }
+
+    auto it = this->_nameIndex.find(name);
+
+    return it != this->_nameIndex.end() ? it->second : npos;
+}
+
+/**
+ * @brief 获取文件解压后的size
+ */
+uint32_t PackageReader::GetEntrySize(uint32_t index) const
+{
+    return GetEntryOutputSize(this->_compressionMethod, this->_entries[index]);
+}
+
+/**
+ * @brief 从指定位置读取，不使用共享的文件指针，多个线程的读取可以同时进行
+ *
+ * @param volume 分卷
+ * @param offset 分卷内偏移
+ * @param buffer 输出缓冲区
+ * @param size 读取的size
+ * @return 函数执行结果
+ */
+bool PackageReader::ReadAt(uint32_t volume, uint64_t offset, void *buffer, uint32_t size) const
+{
+    return ReadFileAt(this->_volumes[volume].File, offset, buffer, size);
+}
+
+/**
+ * @brief 检查文件数据是否在所在分卷的范围内
+ */
+bool PackageReader::IsEntryInRange(uint32_t index) const
+{
+    const auto &entry = this->_entries[index];
+
+    if ((uint64_t)entry.Position + entry.CompressedSize > this->_volumes[this->_entryVolumes[index]].FileSize)
+    {
+        printf("ERROR: Entry %.64s out of range.\n", entry.Name);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 读取并解压文件，不经过缓存
+ *
+ * @param index 文件index
+ * @param buffer 输出缓冲区，size不能小于GetEntrySize()
+ * @return 函数执行结果
+ */
+bool PackageReader::ReadEntry(uint32_t index, uint8_t *buffer) const
+{
+    const auto &entry = this->_entries[index];
+    uint32_t volume = this->_entryVolumes[index];
+
+    if (!this->IsEntryInRange(index)) return false;
+
+    // 直接存储的文件不需要中间缓冲区
+    if (IsStoredEntry(this->_compressionMethod, entry))
+    {
+        if (!this->ReadAt(volume, entry.Position, buffer, entry.CompressedSize))
+        {
+            printf("ERROR: Failed to read %.64s.\n", entry.Name);
+            return false;
+        }
+
+        return true;
+    }
+
+    // 每个线程复用自己的压缩数据缓冲区
+    thread_local std::vector<uint8_t> compressedData;
+    compressedData.resize(entry.CompressedSize);
+
+    if (!this->ReadAt(volume, entry.Position, compressedData.data(), entry.CompressedSize))
+    {
+        printf("ERROR: Failed to read %.64s.\n", entry.Name);
+        return false;
+    }
+
+    return DecompressEntry(this->_compressionMethod, entry, compressedData.data(), buffer);
+}
+
+/**
+ * @brief 读取并解压文件到调用者的缓冲区
+ *
+ * @param index 文件index
+ * @param buffer 输出缓冲区
+ * @param bufferSize 缓冲区size，不能小于GetEntrySize()
+ * @return 函数执行结果
+ */
+bool PackageReader::Read(uint32_t index, uint8_t *buffer, size_t bufferSize) const
+{
+    if (this->_volumes.empty() || index >= this->_entries.size())
+    {
+        return false;
+    }
+
+    const auto &entry = this->_entries[index];
+
+    if (bufferSize < this->GetEntrySize(index))
+    {
+        printf("ERROR: Buffer too small for %.64s.\n", entry.Name);
+        return false;
+    }
+
+    if (this->_cache)
+    {
+        auto data = this->ReadShared(index);
+
+        if (!data) return false;
+
+        memcpy(buffer, data->data(), data->size());
+        return true;
+    }
+
+    return this->ReadEntry(index, buffer);
+}
+
+bool PackageReader::Read(const std::string &name, uint8_t *buffer, size_t bufferSize) const
+{
+    uint32_t index = this->Find(name);
+
+    return index != npos && this->Read(index, buffer, bufferSize);
+}
+
+bool PackageReader::Read(uint32_t index, std::vector<uint8_t> &output) const
+{
+    if (index >= this->_entries.size())
+    {
+        return false;
+    }
+
+    output.resize(this->GetEntrySize(index));
+
+    return this->Read(index, output.data(), output.size());
+}
+
+bool PackageReader::Read(const std::string &name, std::vector<uint8_t> &output) const
+{
+    uint32_t index = this->Find(name);
+
+    return index != npos && this->Read(index, output);
+}
+
+/**
+ * @brief 读取文件在封包里的原始数据，不解压
+ *
+ * @param index 文件index
+ * @param output 输出缓冲区，size为CompressedSize
+ * @return 函数执行结果
+ */
+bool PackageReader::ReadRaw(uint32_t index, std::vector<uint8_t> &output) const
+{
+    if (this->_volumes.empty() || index >= this->_entries.size())
+    {
+        return false;
+    }
+
+    const auto &entry = this->_entries[index];
+    uint32_t volume = this->_entryVolumes[index];
+
+    if (!this->IsEntryInRange(index)) return false;
+
+    output.resize(entry.CompressedSize);
+
+    return this->ReadAt(volume, entry.Position, output.data(), entry.CompressedSize);
+}
+
+/**
+ * @brief 读取文件在封包里的一段原始数据，大文件分块读取时使用
+ *
+ * @param index 文件index
+ * @param offset 在文件数据内的偏移
+ * @param buffer 输出缓冲区
+ * @param size 读取的size，不能超过文件数据的末尾
+ * @return 函数执行结果
+ */
+bool PackageReader::ReadRaw(uint32_t index, uint64_t offset, void *buffer, uint32_t size) const
+{
+    if (this->_volumes.empty() || index >= this->_entries.size())
+    {
+        return false;
+    }
+
+    const auto &entry = this->_entries[index];
+
+    if (offset + size > entry.CompressedSize || !this->IsEntryInRange(index)) return false;
+
+    return this->ReadAt(this->_entryVolumes[index], entry.Position + offset, buffer, size);
+}
+
+/**
+ * @brief 开启解压数据的缓存
+ *
+ * 不是线程安全的，需要在开始读取之前调用
+ *
+ * @param byteBudget 缓存的字节预算
+ * @param shardCount 分片数量
+ */
+void PackageReader::EnableCache(size_t byteBudget, uint32_t shardCount)
+{
+    this->_cache.reset(new EntryCache(byteBudget, shardCount));
+}
+
+/**
+ * @brief 读取并解压文件，返回共享的只读数据
+ *
+ * 开启缓存时命中直接返回缓存里的数据，不拷贝也不解压
+ *
+ * @param index 文件index
+ * @return 解压后的数据，失败返回nullptr
+ */
+EntryData PackageReader::ReadShared(uint32_t index) const
+{
+    if (this->_volumes.empty() || index >= this->_entries.size())
+    {
+        return nullptr;
+    }
+
+    if (this->_cache)
+    {
+        auto data = this->_cache->Get(index);
+
+        if (data) return data;
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(this->GetEntrySize(index));
+
+    if (!this->ReadEntry(index, data->data())) return nullptr;
+
+    if (this->_cache) return this->_cache->Put(index, std::move(data));
+
+    return data;
+}
+
+EntryData PackageReader::ReadShared(const std::string &name) const
+{
+    uint32_t index = this->Find(name);
+
+    return index != npos ? this->ReadShared(index) : nullptr;
+}
+
+/**
+ * @brief 获取缓存的命中/未命中/淘汰计数
+ */
+EntryCacheStats PackageReader::GetCacheStats() const
+{
+    return this->_cache ? this->_cache->GetStats() : EntryCacheStats();
+}
+
+/**
+ * @brief 把一批文件的读取和解压分配到工作线程
+ *
+ * 按文件位置排序后由各线程依次领取，让读取尽量连续，也让大小不一的文件负载均衡
+ *
+ * @param indices 文件index，允许重复和无效的index
+ * @param callback 每个文件完成后调用，参数为在indices里的位置和解压后的数据
+ */
+void PackageReader::SchedulePrefetch(const std::vector<uint32_t> &indices, std::function<void(size_t, EntryData)> callback) const
+{
+    if (indices.empty()) return;
+
+    auto order = std::make_shared<std::vector<size_t>>(indices.size());
+
+    for (size_t i = 0; i < indices.size(); i++) (*order)[i] = i;
+
+    auto GetPosition = [this, &indices](size_t slot) -> uint64_t
+    {
+        return indices[slot] < this->_entries.size() ? this->_entries[indices[slot]].Position : UINT64_MAX;
+    };
+
+    std::sort(order->begin(), order->end(), [&GetPosition](size_t a, size_t b)
+              { return GetPosition(a) < GetPosition(b); });
+
+    auto requested = std::make_shared<std::vector<uint32_t>>(indices);
+    auto cursor = std::make_shared<std::atomic<size_t>>(0);
+
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t workerCount = (uint32_t)std::min<size_t>(maxThreads, indices.size());
+
+    std::lock_guard<std::mutex> lock(this->_prefetchMutex);
+
+    // 清理已经结束的任务
+    this->_prefetchTasks.remove_if([](const std::future<void> &task)
+                                   { return task.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+
+    for (uint32_t n = 0; n < workerCount; n++)
+    {
+        auto task = std::async(std::launch::async, [this, order, requested, cursor, callback]()
+                               {
+                                   size_t i;
+
+                                   while ((i = (*cursor)++) < order->size())
+                                   {
+                                       size_t slot = (*order)[i];
+                                       callback(slot, this->ReadShared((*requested)[slot]));
+                                   }
+                               });
+
+        this->_prefetchTasks.emplace_back(std::move(task));
+    }
+}
+
+/**
+ * @brief 异步预读一批文件
+ *
+ * @param indices 文件index
+ * @return 和indices一一对应的future，失败的文件结果为nullptr
+ */
+std::vector<std::shared_future<EntryData>> PackageReader::Prefetch(const std::vector<uint32_t> &indices) const
+{
+    auto promises = std::make_shared<std::vector<std::promise<EntryData>>>(indices.size());
+
+    std::vector<std::shared_future<EntryData>> futures;
+    futures.reserve(indices.size());
+
+    for (auto &promise : *promises) futures.emplace_back(promise.get_future().share());
+
+    this->SchedulePrefetch(indices, [promises](size_t slot, EntryData data)
+                           { (*promises)[slot].set_value(std::move(data)); });
+
+    return futures;
+}
+
+/**
+ * @brief 按文件名异步预读一批文件
+ *
+ * @param names 文件名，编码和封包内的一致
+ * @return 和names一一对应的future，找不到的文件结果为nullptr
+ */
+std::vector<std::shared_future<EntryData>> PackageReader::Prefetch(const std::vector<std::string> &names) const
+{
+    std::vector<uint32_t> indices;
+    indices.reserve(names.size());
+
+    for (const auto &name : names) indices.emplace_back(this->Find(name));
+
+    return this->Prefetch(indices);
+}
+
+/**
+ * @brief 异步预读一批文件，每个文件完成后调用callback
+ *
+ * callback在工作线程里调用，需要自己保证线程安全，可以用WaitPrefetch等待全部完成
+ *
+ * @param indices 文件index
+ * @param callback 完成回调
+ */
+void PackageReader::Prefetch(const std::vector<uint32_t> &indices, const PrefetchCallback &callback) const
+{
+    auto requested = std::make_shared<std::vector<uint32_t>>(indices);
+
+    this->SchedulePrefetch(indices, [requested, callback](size_t slot, EntryData data)
+                           { callback((*requested)[slot], std::move(data)); });
+}
+
+/**
+ * @brief 等待所有预读任务结束
+ */
+void PackageReader::WaitPrefetch() const
+{
+    std::list<std::future<void>> tasks;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_prefetchMutex);
+        tasks.swap(this->_prefetchTasks);
+    }
+
+    for (auto &task : tasks) task.wait();
+}
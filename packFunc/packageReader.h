@@ -0,0 +1,119 @@
+#ifndef NEXAS_PACKAGE_READER_H
+#define NEXAS_PACKAGE_READER_H
+
+#include "packFunc.h"
+#include "entryCache.h"
+#include "indexCache.h"
+
+#include <functional>
+#include <future>
+#include <unordered_map>
+
+/**
+ * @brief 封包读取器
+ *
+ * 打开时只解码一次索引并建立文件名的hash索引，所有分卷都有有效的.idx时直接映射，
+ * 使用其中预先建立的hash表，之后的读取都是按位置读取，
+ * 不改变共享的文件指针，所以Read系列函数可以在多个线程里同时调用
+ *
+ * EnableCache之后解压的数据会放进LRU缓存，ReadShared命中时直接返回共享的数据
+ *
+ * Prefetch把一批文件的读取和解压分给多个线程同时进行，
+ * 开启缓存时预读的数据会留在缓存里，之后的Read直接命中
+ *
+ * 分卷的封包(data.pac、data.1.pac...)作为一个整体打开，index按分卷的顺序连续编号
+ */
+class PackageReader
+{
+public:
+    static const uint32_t npos = UINT32_MAX;
+
+    // 在工作线程里调用，参数为文件index和解压后的数据(失败为nullptr)
+    using PrefetchCallback = std::function<void(uint32_t, EntryData)>;
+
+    PackageReader() = default;
+
+    ~PackageReader();
+
+    PackageReader(const PackageReader &) = delete;
+
+    PackageReader &operator=(const PackageReader &) = delete;
+
+    bool Open(const std::string &pacPath);
+
+    void Close();
+
+    bool IsOpen() const { return !_volumes.empty(); }
+
+    uint32_t GetVolumeCount() const { return (uint32_t)_volumes.size(); }
+
+    uint32_t GetEntryVolume(uint32_t index) const { return _entryVolumes[index]; }
+
+    uint32_t GetCompressionMethod() const { return _compressionMethod; }
+
+    uint32_t GetEntryCount() const { return (uint32_t)_entries.size(); }
+
+    const PackageEntry &GetEntry(uint32_t index) const { return _entries[index]; }
+
+    const std::vector<PackageEntry> &GetEntries() const { return _entries; }
+
+    uint32_t Find(const std::string &name) const;
+
+    uint32_t GetEntrySize(uint32_t index) const;
+
+    bool Read(uint32_t index, uint8_t *buffer, size_t bufferSize) const;
+
+    bool Read(const std::string &name, uint8_t *buffer, size_t bufferSize) const;
+
+    bool Read(uint32_t index, std::vector<uint8_t> &output) const;
+
+    bool Read(const std::string &name, std::vector<uint8_t> &output) const;
+
+    bool ReadRaw(uint32_t index, std::vector<uint8_t> &output) const;
+
+    bool ReadRaw(uint32_t index, uint64_t offset, void *buffer, uint32_t size) const;
+
+    void EnableCache(size_t byteBudget, uint32_t shardCount = 16);
+
+    EntryData ReadShared(uint32_t index) const;
+
+    EntryData ReadShared(const std::string &name) const;
+
+    EntryCacheStats GetCacheStats() const;
+
+    std::vector<std::shared_future<EntryData>> Prefetch(const std::vector<uint32_t> &indices) const;
+
+    std::vector<std::shared_future<EntryData>> Prefetch(const std::vector<std::string> &names) const;
+
+    void Prefetch(const std::vector<uint32_t> &indices, const PrefetchCallback &callback) const;
+
+    void WaitPrefetch() const;
+
+private:
+    bool ReadAt(uint32_t volume, uint64_t offset, void *buffer, uint32_t size) const;
+
+    bool IsEntryInRange(uint32_t index) const;
+
+    bool ReadEntry(uint32_t index, uint8_t *buffer) const;
+
+    void SchedulePrefetch(const std::vector<uint32_t> &indices, std::function<void(size_t, EntryData)> callback) const;
+
+private:
+    struct VolumeFile
+    {
+        void *File;         // HANDLE
+        uint64_t FileSize;
+    };
+
+    std::vector<VolumeFile> _volumes;
+    std::vector<uint32_t> _entryVolumes;    // 每个文件所在的分卷
+    uint32_t _compressionMethod = 0;
+    std::vector<PackageEntry> _entries;
+    std::unordered_map<std::string, uint32_t> _nameIndex;
+    std::vector<std::unique_ptr<IndexCache>> _indexCaches;  // 每个分卷的.idx，所有分卷都有时代替_nameIndex
+    std::unique_ptr<EntryCache> _cache;
+    mutable std::mutex _prefetchMutex;
+    mutable std::list<std::future<void>> _prefetchTasks;
+};
+
+#endif // NEXAS_PACKAGE_READER_H
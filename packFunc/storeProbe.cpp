@@ -0,0 +1,124 @@
+#include "storeProbe.h"
+#include "codec.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+
+// 抽样的块数和每块的size
+static const size_t ProbeBlockCount = 8;
+static const size_t ProbeBlockSize = 4096;
+
+// 试压缩用的等级，zlib和zstd的1都是最快的等级
+static const int ProbeLevel = 1;
+
+/**
+ * @brief 判断扩展名是否在强制存储的列表里，不区分大小写
+ */
+static bool IsStoreExtension(const std::string &name, const PackOptions &options)
+{
+    auto dot = name.find_last_of('.');
+
+    if (dot == std::string::npos) return false;
+
+    std::string extension = name.substr(dot);
+
+    for (auto &c : extension) c = (char)tolower((unsigned char)c);
+
+    for (const auto &storeExtension : options.StoreExtensions)
+    {
+        if (extension == storeExtension) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief 计算抽样数据的字节熵
+ *
+ * @return 每字节的bit数，范围0~8
+ */
+static double GetSampleEntropy(const uint8_t *data, size_t blockCount, size_t step)
+{
+    uint32_t histogram[256] = {};
+    size_t total = blockCount * ProbeBlockSize;
+
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        const uint8_t *p = data + block * step;
+
+        for (size_t i = 0; i < ProbeBlockSize; i++) histogram[p[i]]++;
+    }
+
+    double entropy = 0.0;
+
+    for (uint32_t count : histogram)
+    {
+        if (!count) continue;
+
+        double p = (double)count / total;
+        entropy -= p * log2(p);
+    }
+
+    return entropy;
+}
+
+bool ShouldStoreFile(const std::string &name, uint32_t compressionMethod, const uint8_t *data, size_t size, const PackOptions &options)
+{
+    if (compressionMethod != 4 && compressionMethod != 7) return true;
+
+    if (IsStoreExtension(name, options)) return true;
+
+    // 太小的文件抽样没有意义，直接压缩，压缩后没有变小再存储
+    if (size < ProbeBlockSize * 2) return false;
+
+    size_t blockCount = size / ProbeBlockSize < ProbeBlockCount ? size / ProbeBlockSize : ProbeBlockCount;
+    size_t step = (size - ProbeBlockSize) / (blockCount - 1);   // 抽样的块均匀分布在整个文件里
+
+    if (GetSampleEntropy(data, blockCount, step) >= options.StoreEntropy) return true;
+
+    // 用最快的等级试压缩，比实际的压缩等级差，所以只用来排除基本压缩不了的数据
+    size_t sampledSize = 0;
+    size_t compressedSize = 0;
+    std::vector<uint8_t> compressedData;
+
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        if (!CompressData(compressionMethod, ProbeLevel, data + block * step, ProbeBlockSize, compressedData)) return false;
+
+        sampledSize += ProbeBlockSize;
+        compressedSize += compressedData.size();
+    }
+
+    return compressedSize >= sampledSize * options.StoreRatio;
+}
+
+bool ShouldStoreFile(const std::string &name, uint32_t compressionMethod, const std::string &path, uint64_t size, const PackOptions &options)
+{
+    if (compressionMethod != 4 && compressionMethod != 7) return true;
+
+    if (IsStoreExtension(name, options)) return true;
+
+    if (size < ProbeBlockSize * ProbeBlockCount) return false;
+
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp) return false;
+
+    // 抽样块连续放在一起，按内存判断时会按顺序取到同样的块
+    std::vector<uint8_t> sample(ProbeBlockCount * ProbeBlockSize);
+    uint64_t step = (size - ProbeBlockSize) / (ProbeBlockCount - 1);
+
+    for (size_t block = 0; block < ProbeBlockCount; block++)
+    {
+        if (_fseeki64(fp, (int64_t)(block * step), SEEK_SET) != 0 || fread(sample.data() + block * ProbeBlockSize, ProbeBlockSize, 1, fp) != 1)
+        {
+            fclose(fp);
+            return false;
+        }
+    }
+
+    fclose(fp);
+
+    return ShouldStoreFile(name, compressionMethod, sample.data(), sample.size(), options);
+}
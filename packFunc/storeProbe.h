@@ -0,0 +1,32 @@
+#ifndef NEXAS_STORE_PROBE_H
+#define NEXAS_STORE_PROBE_H
+
+#include "packFunc.h"
+
+/**
+ * @brief 判断文件是否应该不压缩直接存储
+ *
+ * 先按StoreExtensions强制存储，然后抽样计算字节熵，熵太高的直接存储，
+ * 否则用最快的压缩等级试压缩抽样的几个块，压缩率达不到StoreRatio的也直接存储
+ *
+ * @param name 文件名
+ * @param compressionMethod 封包压缩方式
+ * @param data 文件数据
+ * @param size 文件size
+ * @param options 封包选项
+ * @return 是否直接存储
+ */
+bool ShouldStoreFile(const std::string &name, uint32_t compressionMethod, const uint8_t *data, size_t size, const PackOptions &options);
+
+/**
+ * @brief 判断没有读进内存的大文件是否应该直接存储
+ *
+ * 从文件里读取和上面相同位置的抽样块，再按同样的方法判断
+ *
+ * @param path 源文件路径
+ * @param size 文件size
+ * @return 是否直接存储，读取失败时返回false，按压缩处理
+ */
+bool ShouldStoreFile(const std::string &name, uint32_t compressionMethod, const std::string &path, uint64_t size, const PackOptions &options);
+
+#endif // NEXAS_STORE_PROBE_H
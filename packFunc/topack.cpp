@@ -1,107 +1,36 @@
 #include "packFunc.h"
 
 #include "enc.hpp"
+#include "codec.h"
+#include "hash.hpp"
+#include "checksum.h"
+#include "indexCache.h"
+#include "compressCache.h"
+#include "storeProbe.h"
+#include "dirScanner.h"
+#include "manifest.h"
+#include "layout.h"
+#include "packWriter.h"
+#include "packageReader.h"
 #include "huffman/huffmanEncoder.h"
 #include "quote/header/zlib.h"
 #include "quote/header/zstd.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <thread>
 #include <future>
 #include <chrono>
-#include <list>
-#include <io.h>
 
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::steady_clock;
 
-/**
- * @brief 遍历目标文件夹以及子文件夹,获取文件目录
- * 
- * @param[in] path 目标文件夹路径
- * @return std::list<std::string> 文件名list 
- */
-std::list<std::string> GetFilesInDirectory(const std::string &path)
-{
-    // Result file paths
-    std::list<std::string> filePaths;
-    // Directory paths to search
-    std::list<std::string> directoryPaths;  //需要遍历的文件夹list,用list的方式来避免递归
-
-    // Add root path to start
-    directoryPaths.emplace_back(path);  //添加目标文件夹
-
-    while (!directoryPaths.empty())
-    {
-        // Get path
-        std::string currentPath = std::move(directoryPaths.front());
-        directoryPaths.pop_front();
-
-        // Make full path search pattern
-        std::string pattern;
-        pattern.reserve(currentPath.size() + 4);    //预先设置容量，防止再分配
-        pattern.append(currentPath);
-        pattern.append("\\*.*");
-
-        // Start search
-        _finddata_t data;
-        intptr_t handle = _findfirst(pattern.c_str(), &data);
-
-        if (handle == -1)
-        {
-            // Ignore invalid path
-            continue;
-        }
-
-        do
-        {
-            size_t nameLength = strlen(data.name);
-
-            if (data.attrib & _A_SUBDIR)
-            {
-                // We need ignore special directory e.g "." and ".."
-                int j = 0;
-
-                while (j < nameLength)
-                {
-                    if (data.name[j] != '.')    //文件夹名不能带.
-                    {
-                        // Should be a valid subdirectory name
-                        break;
-                    }
-                    j++;
-                }
-
-                if (j < nameLength)
-                {
-                    // Append subdirectory path to the list and search later
-                    std::string newPath;
-                    newPath.reserve(currentPath.size() + 1 + nameLength);
-                    newPath.append(currentPath);
-                    newPath.push_back('\\');
-                    newPath.append(data.name);
-                    directoryPaths.emplace_back(std::move(newPath));
-                }
-            }
-            else
-            {
-                // Append file path to the result
-                std::string newPath;
-                newPath.reserve(currentPath.size() + 1 + nameLength);
-                newPath.append(currentPath);
-                newPath.push_back('\\');
-                newPath.append(data.name);
-                filePaths.emplace_back(std::move(newPath));
-            }
-
-        } while (_findnext(handle, &data) == 0);
-
-        _findclose(handle);
-    }
-
-    return filePaths;
-}
-
 /**
  * @brief 根据文件路径获取文件名
  * 
@@ -172,7 +101,7 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
 {
     auto tp1 = steady_clock::now();
 
-    auto files = GetFilesInDirectory(dirPath);  //声明时调用函数初始化，编译器自动传入目标变量指针来优化，防止拷贝
+    auto files = ScanDirectory(dirPath);  //声明时调用函数初始化，编译器自动传入目标变量指针来优化，防止拷贝
 
     if (files.empty())
     {
@@ -205,8 +134,10 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
 
     std::vector<uint8_t> compressedData;
 
-    for (auto &path : files)    //遍历所有文件
+    for (auto &file : files)    //遍历所有文件
     {
+        const auto &path = file.Path;
+
         auto name = GetFileName(path);
 
         if(codePage==CP_UTF8) AnsiToUTF8(name);
@@ -229,15 +160,13 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
         uint32_t originalSize = data.size();
         uint32_t compressedSize = originalSize;
 
-        //根据文件扩展名，排除掉一些文件，不进行压缩
-        auto extension = name.substr(name.find_last_of('.'));
-        if (extension == ".ogg" || extension == ".png" || extension == ".wav" || extension == ".fnt")
+        // 抽样判断是否值得压缩，压缩不了的文件直接存储
+        if (ShouldStoreFile(name, compressionMethod, data.data(), data.size(), PackOptions()))
         {
             fwrite(data.data(), originalSize, 1, fp);
         }
         else
         {
-
             if (compressionMethod == 4)
             {
                 uLong sourceLen = data.size();
@@ -255,9 +184,6 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
                 }
 
                 compressedData.resize(destLen);
-                compressedSize = destLen;
-
-                fwrite(compressedData.data(), compressedSize, 1, fp);
             }
             else if (compressionMethod == 7)
             {
@@ -275,7 +201,12 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
                 }
 
                 compressedData.resize(result);
-                compressedSize = result;
+            }
+
+            // 压缩后没有变小的直接存储，封包里压缩前后size相同就表示没有压缩
+            if (compressedData.size() < originalSize)
+            {
+                compressedSize = compressedData.size();
 
                 fwrite(compressedData.data(), compressedSize, 1, fp);
             }
@@ -333,224 +264,1938 @@ bool CreatePackage(const std::string &pacPath, const std::string &dirPath, int c
 // 多线程处理
 //////////////////////////////////////////////////////////////////
 
+/**
+ * @brief 分块压缩的临时文件，最后一个引用释放时删除
+ */
+struct SpillFile
+{
+    std::string Path;
+
+    ~SpillFile() { DeleteFileA(this->Path.c_str()); }
+};
+
 struct FileData
 {
     std::string Name;   //文件名
     std::vector<uint8_t> Data;  //压缩后数据的缓冲区
     uint32_t OriginalSize = 0;  //原始size
     uint32_t CompressedSize = 0;    //压缩后size
+    int64_t ModifyTime = 0;     //源文件修改时间
+    uint64_t OriginalHash = 0;  //原始数据的XXH64
+    uint64_t CompressedHash = 0;    //写入封包的数据的XXH64，只在输出.sum时计算
+    bool Reused = false;        //数据直接从上一个封包复制
+    bool Duplicate = false;     //和其他文件内容相同，没有数据，写入时指向同一份数据
+    bool Streamed = false;      //大文件没有读进内存，写入时从文件分块复制
+    std::string Path;           //分块压缩时的源文件路径
+    bool Store = false;         //分块压缩时是否直接存储
+    std::shared_ptr<SpillFile> Spill;   //分块压缩时压缩后的数据，直接存储时为空
+    uint32_t BaseIndex = PackageReader::npos;   //分块复用时基准封包里的文件index
 };
 
 /**
- * @brief 
- * @param[in] path  目标文件
- * @param[in] compressionMethod 压缩方式  
- * 
- * @return FileDate 压缩后写入封包需要的信息
+ * @brief 去重时用来比较文件内容的key
  */
-FileData ReadAndCompressFile(const std::string &path, int compressionMethod,int codePage)
+struct ContentKey
 {
-    auto name = GetFileName(path);
+    uint64_t Hash;
+    uint32_t Size;
+
+    bool operator==(const ContentKey &other) const { return this->Hash == other.Hash && this->Size == other.Size; }
+};
 
-    if(codePage==CP_UTF8) name = AnsiToUTF8(name); 
+struct ContentKeyHasher
+{
+    size_t operator()(const ContentKey &key) const { return (size_t)(key.Hash ^ key.Size); }
+};
 
-    if (name.size() >= sizeof(PackageEntry::Name))
+/**
+ * @brief 多线程封包时各线程共享的状态
+ */
+struct PackState
+{
+    const PackOptions *Options = nullptr;
+    int CompressionMethod = 0;
+    int CodePage = 0;
+
+    PackageReader BaseReader;                   // 增量封包的基准封包
+    std::vector<ChecksumEntry> BaseChecksums;   // 和基准封包的索引一一对应，没有.sum时为空
+
+    std::unique_ptr<CompressCache> Cache;       // 压缩结果缓存，未指定缓存目录时为空
+
+    std::string SpillPrefix;                    // 分块压缩的临时文件路径前缀
+    std::atomic<uint32_t> SpillCount{0};
+
+    std::mutex DedupMutex;
+    std::unordered_set<ContentKey, ContentKeyHasher> DedupClaims;   // 已经有线程在处理的内容
+    std::atomic<uint64_t> DedupSkippedBytes{0};                     // 去重跳过压缩的原始size
+
+    std::atomic<uint32_t> StoredCount{0};     // 压缩不了直接存储的文件
+    std::atomic<uint64_t> StoredBytes{0};
+    std::atomic<uint32_t> ReusedCount{0};
+    std::atomic<uint64_t> ReusedBytes{0};
+};
+
+/**
+ * @brief 打开增量封包的基准封包和它的.sum，.sum的标记要和基准封包一致
+ *
+ * @param state 封包状态
+ * @return 函数执行结果，基准封包不能用时返回false
+ */
+static bool OpenBasePackage(PackState &state)
+{
+    const auto &basePath = state.Options->BasePath;
+
+    if (!state.BaseReader.Open(basePath))
     {
-        printf("WARNING: File name '%s' too long.", name.c_str());
-        return {};
+        printf("WARNING: Failed to open base package, every file will be compressed.\n");
+        return false;
+    }
+
+    if (state.BaseReader.GetCompressionMethod() != (uint32_t)state.CompressionMethod)
+    {
+        printf("WARNING: Base package uses a different compression method, every file will be compressed.\n");
+        state.BaseReader.Close();
+        return false;
     }
 
-    auto data = ReadFileData(path);
+    auto &checksums = state.BaseChecksums;
 
-    if (data.empty())
+    // 写入.sum之后基准封包改变过时，ReadPackageChecksums当作没有.sum，逐个比较文件内容
+    if (ReadPackageChecksums(basePath, checksums))
     {
-        printf("ERROR: Failed to read file '%s'.", path.c_str());
-        return {};
+        // .sum和封包的索引对不上时当作没有
+        bool matched = checksums.size() == state.BaseReader.GetEntryCount();
+
+        for (uint32_t i = 0; matched && i < checksums.size(); i++)
+        {
+            const auto &entry = state.BaseReader.GetEntry(i);
+            matched = memcmp(checksums[i].Name, entry.Name, sizeof(entry.Name)) == 0 && checksums[i].CompressedSize == entry.CompressedSize;
+        }
+
+        if (!matched)
+        {
+            printf("WARNING: Checksum file does not match the base package, ignored.\n");
+            checksums.clear();
+        }
     }
 
-    std::vector<uint8_t> compressedData;
+    printf("Base package has %u files%s.\n", state.BaseReader.GetEntryCount(), checksums.empty() ? " (no checksum file, comparing contents)" : "");
+
+    return true;
+}
+
+/**
+ * @brief 分块读取文件
+ *
+ * @param path 文件路径
+ * @param size 读取的size，文件变小时读取失败
+ * @param hash 不为nullptr时计算读取的数据的hash
+ * @param output 输出
+ * @return 函数执行结果
+ */
+static bool CopyFileChunks(const std::string &path, uint64_t size, XXHash64 *hash, const StreamWriter &output)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp) return false;
 
-    //根据文件扩展名，排除掉一些文件，不进行压缩
-    auto extension = name.substr(name.find_last_of('.'));
+    std::vector<uint8_t> buffer((size_t)std::min<uint64_t>(std::max<uint64_t>(size, 1), 1024 * 1024));
+    uint64_t copied = 0;
+    bool result = true;
 
-    if (extension == ".ogg" || extension == ".png" || extension == ".wav" || extension == ".fnt")
+    while (result && copied < size)
     {
-        size_t srcSize = data.size();
+        size_t chunk = (size_t)std::min<uint64_t>(buffer.size(), size - copied);
+
+        result = fread(buffer.data(), chunk, 1, fp) == 1;
+
+        if (result && hash) hash->Update(buffer.data(), chunk);
+        if (result) result = output(buffer.data(), chunk);
 
-        return {std::move(name), std::move(data), (uint32_t)srcSize, (uint32_t)srcSize};
+        copied += chunk;
     }
-    else
+
+    fclose(fp);
+
+    return result;
+}
+
+/**
+ * @brief 分块读取基准封包里文件的原始数据
+ *
+ * @param reader 基准封包
+ * @param index 文件index
+ * @param output 输出
+ * @return 函数执行结果
+ */
+static bool ReadBaseChunks(const PackageReader &reader, uint32_t index, const StreamWriter &output)
+{
+    const uint32_t size = reader.GetEntry(index).CompressedSize;
+
+    std::vector<uint8_t> buffer(std::min<uint32_t>(std::max<uint32_t>(size, 1), 1024 * 1024));
+
+    for (uint32_t offset = 0; offset < size;)
     {
-        if (compressionMethod == 4)
-        {
-            uLong sourceLen = data.size();
-            uLong destLen = compressBound(sourceLen);
+        uint32_t chunk = std::min<uint32_t>((uint32_t)buffer.size(), size - offset);
 
-            compressedData.resize(destLen);
+        if (!reader.ReadRaw(index, offset, buffer.data(), chunk) || !output(buffer.data(), chunk)) return false;
 
-            int result = compress2(compressedData.data(), &destLen, data.data(), sourceLen, Z_BEST_COMPRESSION);
+        offset += chunk;
+    }
 
-            if (result != Z_OK)
-            {
-                printf("ERROR: Failed to compress file '%s' with zlib.", path.c_str());
-            }
+    return true;
+}
+
+/**
+ * @brief 分块比较源文件和基准封包里的文件，内存占用和文件size无关
+ *
+ * @param reader 基准封包
+ * @param index 文件index
+ * @param file 源文件
+ * @param[out] hash 相同时为源文件的XXH64
+ * @return 内容是否相同
+ */
+static bool CompareBaseEntry(const PackageReader &reader, uint32_t index, const ScannedFile &file, uint64_t &hash)
+{
+    const auto &entry = reader.GetEntry(index);
 
-            compressedData.resize(destLen);
+    FILE *fp = fopen(file.Path.c_str(), "rb");
 
-            return {std::move(name), std::move(compressedData), (uint32_t)data.size(), destLen};
-        }
-        else if (compressionMethod == 7)
+    if (!fp) return false;
+
+    XXHash64 fileHash;
+    std::vector<uint8_t> fileBuffer;
+    uint64_t compared = 0;
+
+    // 解压出的每一块依次和源文件的下一段比较，不同时停止
+    auto compare = [&](const uint8_t *data, size_t size)
+    {
+        fileBuffer.resize(size);
+
+        if (compared + size > file.Size || fread(fileBuffer.data(), size, 1, fp) != 1 || memcmp(fileBuffer.data(), data, size) != 0)
         {
-            size_t srcSize = data.size();
-            size_t dstSize = ZSTD_compressBound(srcSize);
+            return false;
+        }
 
-            compressedData.resize(dstSize);
+        fileHash.Update(data, size);
+        compared += size;
 
-            size_t result = ZSTD_compress(compressedData.data(), dstSize, data.data(), srcSize, ZSTD_maxCLevel());
+        return true;
+    };
 
-            if (ZSTD_isError(result))
-            {
-                printf("ERROR: Failed to compress file '%s' with zstd.", path.c_str());
-            }
+    bool matched;
 
-            compressedData.resize(result);
+    if (IsStoredEntry(reader.GetCompressionMethod(), entry))
+    {
+        matched = ReadBaseChunks(reader, index, compare);
+    }
+    else
+    {
+        uint64_t offset = 0;
 
-            return {std::move(name), std::move(compressedData), (uint32_t)data.size(), (uint32_t)result};
-        }
-        else
+        auto baseReader = [&](uint8_t *buffer, size_t bufferSize, size_t &readSize)
         {
-            size_t srcSize = data.size();
+            readSize = (size_t)std::min<uint64_t>(bufferSize, entry.CompressedSize - offset);
 
-            return {std::move(name), std::move(data), (uint32_t)srcSize,(uint32_t)srcSize};
-        }
+            if (readSize && !reader.ReadRaw(index, offset, buffer, (uint32_t)readSize)) return false;
+
+            offset += readSize;
+
+            return true;
+        };
+
+        matched = DecompressStream(reader.GetCompressionMethod(), entry.OriginalSize, baseReader, compare);
     }
+
+    fclose(fp);
+
+    if (!matched || compared != file.Size) return false;
+
+    hash = fileHash.Digest();
+
+    return true;
 }
 
 /**
- * @brief 多线程压缩
- * 
- * @param pacPath 要写入的目标封包
- * @param dirPath 源文件夹
- * @param compressionMethod 压缩方式 
- * @return 函数执行结果
+ * @brief 增量封包时尝试复用基准封包里的压缩数据
+ *
+ * 有.sum时先比较size和修改时间，修改时间不同再比较hash；
+ * 没有.sum时解压旧数据逐字节比较，解压比重新压缩快得多
+ *
+ * 不小于StreamSize的大文件分块读取和比较，data保持为空，
+ * 复用时不读取旧数据，写入时由WriteStreamedFile从基准封包分块复制
+ *
+ * @param[in] file 源文件
+ * @param[in] name 封包内的文件名
+ * @param[in] state 封包状态
+ * @param[out] data 比较时读取的源文件数据，不能复用时留给后面压缩
+ * @param[out] result 复用的数据
+ * @return 是否复用
  */
-bool CreatePackageMT(const std::string &pacPath, const std::string &dirPath, int compressionMethod,int codePage)
+static bool ReuseBaseEntry(const ScannedFile &file, const std::string &name, PackState *state, std::vector<uint8_t> &data, FileData &result)
 {
-    auto tp1 = steady_clock::now();
+    const auto &reader = state->BaseReader;
 
-    auto files = GetFilesInDirectory(dirPath);
+    uint32_t index = reader.Find(name);
 
-    if (files.empty())
+    if (index == PackageReader::npos || reader.GetEntrySize(index) != file.Size)
     {
-        printf("ERROR: No any files to pack.");
         return false;
     }
 
-    // 创建索引数据块，内存连续
-    std::vector<PackageEntry> entries;
-    entries.resize(files.size());
+    const bool streamed = file.Size >= state->Options->StreamSize;
 
-    FILE *fp = fopen(pacPath.c_str(), "wb");
+    uint64_t hash = 0;
+    bool matched = false;
 
-    if (!fp)
+    if (!state->BaseChecksums.empty())
     {
-        printf("ERROR: Failed to create package file.");
-        return false;
+        const auto &checksum = state->BaseChecksums[index];
+
+        if (!state->Options->BaseHash && checksum.ModifyTime == file.ModifyTime)
+        {
+            hash = checksum.OriginalHash;
+            matched = true;
+        }
+        else if (streamed)
+        {
+            XXHash64 fileHash;
+
+            auto discard = [](const uint8_t *, size_t) { return true; };
+
+            matched = CopyFileChunks(file.Path, file.Size, &fileHash, discard) && (hash = fileHash.Digest()) == checksum.OriginalHash;
+        }
+        else
+        {
+            data = ReadFileData(file.Path);
+            hash = XXHash64::Compute(data.data(), data.size());
+            matched = !data.empty() && hash == checksum.OriginalHash;
+        }
+    }
+    else if (streamed)
+    {
+        matched = CompareBaseEntry(reader, index, file, hash);
     }
+    else
+    {
+        std::vector<uint8_t> baseData;
 
-    printf("Total %d files to pack.\n", files.size());
+        data = ReadFileData(file.Path);
+        matched = !data.empty() && reader.Read(index, baseData) && baseData == data;
 
-    // 写文件头
-    uint8_t magic[] = {0x50, 0x41, 0x43, 0x75};
-    fwrite(magic, 4, 1, fp);
+        if (matched) hash = XXHash64::Compute(data.data(), data.size());
+    }
 
-    // 这里先不写数量，因为读取或压缩的时候可能会发生错误，跳过一些文件，所以后面再更新数量
-    uint32_t entryCount = 0;
+    if (!matched) return false;
 
-    fwrite(&entryCount, 4, 1, fp);
-    fwrite(&compressionMethod, 4, 1, fp);
+    if (streamed)
+    {
+        result.Streamed = true;
+        result.Path = file.Path;
+        result.BaseIndex = index;
+    }
+    else if (!reader.ReadRaw(index, result.Data))
+    {
+        return false;
+    }
 
-    // 实际处理了的文件数量
-    uint32_t i = 0;
+    const auto &baseEntry = reader.GetEntry(index);
 
-    // 取CPU线程数量
-    uint32_t maxThreads = std::thread::hardware_concurrency();
+    result.Name = name;
+    result.OriginalSize = baseEntry.OriginalSize;
+    result.CompressedSize = baseEntry.CompressedSize;
+    result.ModifyTime = file.ModifyTime;
+    result.OriginalHash = hash;
+    result.Reused = true;
 
-    std::vector<std::future<FileData>> tasks;  //任务池
-    tasks.reserve(maxThreads);
+    state->ReusedCount++;
+    state->ReusedBytes += baseEntry.OriginalSize;
 
-    while (!files.empty())
-    {
-        // 创建线程并行读取和压缩
+    return true;
+}
 
-        tasks.clear();
+/**
+ * @brief 去重时认领一份内容，第一个认领的线程负责压缩
+ *
+ * @param state 封包状态
+ * @param key 文件内容
+ * @return 是否第一次出现
+ */
+static bool ClaimContent(PackState *state, const ContentKey &key)
+{
+    std::lock_guard<std::mutex> lock(state->DedupMutex);
 
-        for (uint32_t n = 0; n < maxThreads; n++)
-        {
-            if (files.empty())
-                break;
+    return state->DedupClaims.insert(key).second;
+}
 
-            // 取出一个文件名然后创建线程来读取
-            auto &path = files.front();
-            auto task = std::async(std::launch::async, ReadAndCompressFile, std::move(path), compressionMethod,codePage);    //std::launch::async 强制创建新线程执行
-            tasks.emplace_back(std::move(task));
-            files.pop_front();
-        }
+/**
+ * @brief 获取文件在封包内的文件名
+ *
+ * @param item 目标文件，清单指定了文件名时使用清单的
+ * @param codePage 封包文件名的编码
+ * @return 文件名
+ */
+static std::string GetEntryName(const PackItem &item, int codePage)
+{
+    auto name = item.Name.empty() ? GetFileName(item.File.Path) : item.Name;
 
-        // 获取文件数据
+    if (codePage == CP_UTF8) name = AnsiToUTF8(name);
 
-        for (auto &task : tasks)
-        {
-            auto result = task.get();
+    return name;
+}
 
-            if (result.Data.empty())
-                continue; // 读取或者压缩失败了
+/**
+ * @brief 获取文件的压缩等级，清单里指定的优先，其次是命令行指定的
+ */
+static int GetItemLevel(const PackItem &item, const PackState *state)
+{
+    if (item.HasLevel) return item.Level;
 
-            auto &entry = entries[i];
+    return state->Options->HasLevel ? state->Options->Level : GetDefaultCompressionLevel(state->CompressionMethod);
+}
 
-            strcpy_s(entry.Name, result.Name.c_str());
-            entry.Position = ftell(fp);
-            entry.OriginalSize = result.OriginalSize;
-            entry.CompressedSize = result.CompressedSize;
+/**
+ * @brief 在工作线程里分块压缩大文件，压缩后的数据写到临时文件
+ *
+ * 读取和压缩都通过固定size的缓冲区，压缩后的size达到原始size时停止压缩，改为直接存储
+ *
+ * @param result 分块压缩的文件，更新Store、CompressedSize、OriginalHash、CompressedHash和Spill
+ * @param state 封包状态
+ * @param level 压缩等级
+ * @return 函数执行结果
+ */
+static bool CompressStreamedFile(FileData &result, PackState *state, int level)
+{
+    const uint64_t originalSize = result.OriginalSize;
 
-            fwrite(result.Data.data(), result.Data.size(), 1, fp);
+    FILE *fp = fopen(result.Path.c_str(), "rb");
 
-            i++;
-        }
+    if (!fp)
+    {
+        printf("ERROR: Failed to read file '%s'.\n", result.Path.c_str());
+        return false;
     }
 
-    entryCount = i;
+    auto spill = std::make_shared<SpillFile>();
+    spill->Path = state->SpillPrefix + std::to_string(state->SpillCount++) + ".tmp";
 
-    uint8_t* const index = reinterpret_cast<uint8_t*>(entries.data());
-    auto indexSize = sizeof(PackageEntry) * entryCount;
+    FILE *out = fopen(spill->Path.c_str(), "wb");
 
-    // 压缩索引
-    HuffmanEncoder huffmanEncoder;
-    std::vector<uint8_t> compressedIndex = huffmanEncoder.Encode(index,indexSize);
+    if (!out)
+    {
+        printf("ERROR: Failed to create temporary file '%s'.\n", spill->Path.c_str());
+        fclose(fp);
+        return false;
+    }
 
-    uint32_t compressedIndexSize = compressedIndex.size();
+    XXHash64 hash;
+    XXHash64 compressedHash;
+    uint64_t readBytes = 0;
+    uint64_t compressedBytes = 0;
+    bool tooLarge = false;
 
-    // 加密
-    for (uint32_t i = 0; i < compressedIndexSize; i++)
+    // 只读取遍历时的size，文件变小时读取失败
+    auto reader = [&](uint8_t *buffer, size_t bufferSize, size_t &readSize)
     {
-        compressedIndex[i] = ~compressedIndex[i];
-    }
+        readSize = (size_t)std::min<uint64_t>(bufferSize, originalSize - readBytes);
 
-    fwrite(compressedIndex.data(), compressedIndexSize, 1, fp);
-    fwrite(&compressedIndexSize, 4, 1, fp);
+        if (readSize && fread(buffer, readSize, 1, fp) != 1) return false;
 
-    // 回去更新文件数量
-    fseek(fp, 4, SEEK_SET);
-    fwrite(&entryCount, 4, 1, fp);
+        hash.Update(buffer, readSize);
+        readBytes += readSize;
+
+        return true;
+    };
+
+    auto output = [&](const uint8_t *data, size_t size)
+    {
+        compressedBytes += size;
+
+        // 压缩后没有变小，不用继续压缩了
+        if (compressedBytes >= originalSize)
+        {
+            tooLarge = true;
+            return false;
+        }
+
+        compressedHash.Update(data, size);
+
+        return fwrite(data, size, 1, out) == 1;
+    };
+
+    bool compressed = CompressStream(state->CompressionMethod, level, originalSize, reader, output);
 
-    fflush(fp);
     fclose(fp);
 
-    auto tp2 = steady_clock::now();
+    if (fclose(out) != 0) compressed = false;
 
-    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+    if (compressed)
+    {
+        result.CompressedSize = (uint32_t)compressedBytes;
+        result.OriginalHash = hash.Digest();
+        result.CompressedHash = compressedHash.Digest();
+        result.Spill = std::move(spill);
+        return true;
+    }
 
-    printf("[MT] Packed %d files in %llu ms.\n", entryCount, ms);
+    // 临时文件在spill释放时删除
+    if (tooLarge)
+    {
+        result.Store = true;
+        return true;
+    }
+
+    printf("ERROR: Failed to compress file '%s' with %s.\n", result.Path.c_str(), GetCompressionName(state->CompressionMethod));
+
+    return false;
+}
+
+/**
+ * @brief 准备分块压缩的大文件
+ *
+ * 只读取几个抽样块判断是否直接存储，需要压缩的在工作线程里压缩到临时文件，
+ * 写入时由WriteStreamedFile分块复制，写入线程不做压缩
+ *
+ * @param item 目标文件
+ * @param name 封包内的文件名
+ * @param state 封包状态
+ * @return 没有数据的FileData，直接存储时OriginalHash在写入之后才知道，失败时Streamed为false
+ */
+static FileData PrepareStreamedFile(const PackItem &item, std::string name, PackState *state)
+{
+    const int compressionMethod = state->CompressionMethod;
+
+    FileData fileData;
+    fileData.Name = std::move(name);
+    fileData.OriginalSize = (uint32_t)item.File.Size;
+    fileData.ModifyTime = item.File.ModifyTime;
+    fileData.Streamed = true;
+    fileData.Path = item.File.Path;
+
+    if (item.Method == EntryMethod::Store)
+        fileData.Store = true;
+    else if (item.Method == EntryMethod::Auto)
+        fileData.Store = ShouldStoreFile(fileData.Name, compressionMethod, item.File.Path, item.File.Size, *state->Options);
+    else
+        fileData.Store = compressionMethod != 4 && compressionMethod != 7;
+
+    if (!fileData.Store && !CompressStreamedFile(fileData, state, GetItemLevel(item, state))) return {};
+
+    // 直接存储时写入的就是原始数据
+    if (fileData.Store) fileData.CompressedSize = fileData.OriginalSize;
+
+    return fileData;
+}
+
+/**
+ * @brief 写入分块压缩的大文件
+ *
+ * 压缩已经在工作线程里完成，这里只从临时文件复制；直接存储的从源文件复制，同时计算hash；
+ * 复用基准封包的从基准封包复制，同时计算写入数据的hash
+ *
+ * @param result PrepareStreamedFile的结果，直接存储时写入后更新OriginalHash和CompressedHash
+ * @param state 封包状态
+ * @param output 输出，依次写入result.CompressedSize字节
+ * @return 函数执行结果
+ */
+static bool WriteStreamedFile(FileData &result, PackState *state, const StreamWriter &output)
+{
+    if (result.BaseIndex != PackageReader::npos)
+    {
+        XXHash64 hash;
+
+        auto copy = [&](const uint8_t *data, size_t size)
+        {
+            hash.Update(data, size);
+            return output(data, size);
+        };
+
+        if (!ReadBaseChunks(state->BaseReader, result.BaseIndex, copy))
+        {
+            printf("ERROR: Failed to read '%s' from base package.\n", result.Name.c_str());
+            return false;
+        }
+
+        result.CompressedHash = hash.Digest();
+
+        return true;
+    }
+
+    if (result.Spill)
+    {
+        if (!CopyFileChunks(result.Spill->Path, result.CompressedSize, nullptr, output))
+        {
+            printf("ERROR: Failed to write file '%s'.\n", result.Path.c_str());
+            return false;
+        }
+
+        // 写完就删除临时文件
+        result.Spill.reset();
+
+        return true;
+    }
+
+    XXHash64 hash;
+
+    if (!CopyFileChunks(result.Path, result.OriginalSize, &hash, output))
+    {
+        printf("ERROR: Failed to read file '%s'.\n", result.Path.c_str());
+        return false;
+    }
+
+    result.OriginalHash = hash.Digest();
+    result.CompressedHash = result.OriginalHash;
+
+    state->StoredCount++;
+    state->StoredBytes += result.OriginalSize;
+
+    return true;
+}
+
+/**
+ * @brief 
+ * @param[in] item  目标文件，包括遍历时得到的size和修改时间，以及清单指定的文件名和压缩方式
+ * @param[in] state 封包状态
+ * 
+ * @return FileDate 压缩后写入封包需要的信息
+ */
+FileData ReadAndCompressFile(const PackItem &item, PackState *state)
+{
+    const auto &file = item.File;
+    const auto &path = file.Path;
+    const int compressionMethod = state->CompressionMethod;
+
+    auto name = GetEntryName(item, state->CodePage);
+
+    if (name.size() >= sizeof(PackageEntry::Name))
+    {
+        printf("WARNING: File name '%s' too long.", name.c_str());
+        return {};
+    }
+
+    // 索引里的size是uint32_t
+    if (file.Size > UINT32_MAX)
+    {
+        printf("ERROR: File '%s' is larger than 4 GB.", path.c_str());
+        return {};
+    }
+
+    std::vector<uint8_t> data;
+
+    if (state->BaseReader.IsOpen())
+    {
+        FileData fileData;
+
+        if (ReuseBaseEntry(file, name, state, data, fileData)) return fileData;
+    }
+
+    // 大文件不读进内存，写入时再分块压缩，比较基准封包时已经读进内存的除外
+    if (data.empty() && file.Size >= state->Options->StreamSize)
+    {
+        return PrepareStreamedFile(item, std::move(name), state);
+    }
+
+    if (data.empty()) data = ReadFileData(path);
+
+    if (data.empty())
+    {
+        printf("ERROR: Failed to read file '%s'.", path.c_str());
+        return {};
+    }
+
+    FileData fileData;
+    fileData.Name = std::move(name);
+    fileData.OriginalSize = (uint32_t)data.size();
+    fileData.ModifyTime = file.ModifyTime;
+    fileData.OriginalHash = XXHash64::Compute(data.data(), data.size());
+
+    // 相同内容的文件只压缩一次
+    if (state->Options->Dedup && !ClaimContent(state, {fileData.OriginalHash, fileData.OriginalSize}))
+    {
+        fileData.Duplicate = true;
+        state->DedupSkippedBytes += fileData.OriginalSize;
+        return fileData;
+    }
+
+    if (compressionMethod != 4 && compressionMethod != 7)
+    {
+        fileData.CompressedSize = fileData.OriginalSize;
+        fileData.Data = std::move(data);
+        return fileData;
+    }
+
+    // 清单可以指定直接存储或者总是压缩，否则抽样判断是否值得压缩，压缩不了的文件直接存储
+    if (item.Method == EntryMethod::Store ||
+        (item.Method == EntryMethod::Auto && ShouldStoreFile(fileData.Name, compressionMethod, data.data(), data.size(), *state->Options)))
+    {
+        state->StoredCount++;
+        state->StoredBytes += fileData.OriginalSize;
+
+        fileData.CompressedSize = fileData.OriginalSize;
+        fileData.Data = std::move(data);
+        return fileData;
+    }
+
+    std::vector<uint8_t> compressedData;
+    int level = GetItemLevel(item, state);
+
+    // 缓存命中时跳过压缩
+    if (!state->Cache || !state->Cache->Get(fileData.OriginalHash, fileData.OriginalSize, compressionMethod, level, compressedData))
+    {
+        if (!CompressData(compressionMethod, level, data.data(), data.size(), compressedData))
+        {
+            printf("ERROR: Failed to compress file '%s' with %s.", path.c_str(), GetCompressionName(compressionMethod));
+            return {};
+        }
+
+        if (state->Cache) state->Cache->Put(fileData.OriginalHash, fileData.OriginalSize, compressionMethod, level, compressedData);
+    }
+
+    // 压缩后没有变小的直接存储，封包里压缩前后size相同就表示没有压缩
+    if (compressedData.size() >= data.size())
+    {
+        state->StoredCount++;
+        state->StoredBytes += fileData.OriginalSize;
+
+        fileData.CompressedSize = fileData.OriginalSize;
+        fileData.Data = std::move(data);
+        return fileData;
+    }
+
+    fileData.CompressedSize = (uint32_t)compressedData.size();
+    fileData.Data = std::move(compressedData);
+
+    return fileData;
+}
+
+/**
+ * @brief 读取并压缩文件，输出.sum时趁数据还在缓存里计算写入数据的hash
+ *
+ * @param item 目标文件
+ * @param state 封包状态
+ * @return FileData 压缩后写入封包需要的信息
+ */
+static FileData ProcessFile(const PackItem &item, PackState *state)
+{
+    auto result = ReadAndCompressFile(item, state);
+
+    if ((state->Options->WriteChecksum || !state->Options->BasePath.empty()) && !result.Data.empty())
+    {
+        result.CompressedHash = XXHash64::Compute(result.Data.data(), result.Data.size());
+    }
+
+    return result;
+}
+
+/**
+ * @brief 获取要写入封包的文件
+ *
+ * @param dirPath 源文件夹，以@开头时为清单文件
+ * @param compressionMethod 压缩方式
+ * @param items 输出要写入的文件，按写入顺序排列
+ * @return 函数执行结果
+ */
+static bool CollectPackItems(const std::string &dirPath, int compressionMethod, std::vector<PackItem> &items)
+{
+    if (!dirPath.empty() && dirPath[0] == '@')
+    {
+        return ReadManifest(dirPath.substr(1), compressionMethod, items);
+    }
+
+    auto files = ScanDirectory(dirPath);
+
+    items.reserve(files.size());
+
+    for (auto &file : files)
+    {
+        PackItem item;
+        item.File = std::move(file);
+        items.emplace_back(std::move(item));
+    }
+
+    return true;
+}
+
+// 文件头: magic(4) + 文件数量(4) + 压缩方式(4)，后面是分卷标记
+static const uint64_t PackageHeaderSize = 12 + sizeof(VolumeTag);
+
+/**
+ * @brief 估计索引需要的空间
+ *
+ * 索引用Huffman压缩，平均码长不超过9bit，这里按原始size的2倍预留
+ */
+static uint64_t GetIndexReserve(uint32_t entryCount)
+{
+    return (uint64_t)entryCount * sizeof(PackageEntry) * 2 + 4096;
+}
+
+/**
+ * @brief 创建分卷并写入文件头和分卷标记
+ *
+ * 文件数量、封包标识和分卷数量先写0，所有文件写完之后在WriteVolumeIndex里更新
+ *
+ * @param writer 分卷的输出
+ * @param path 分卷路径
+ * @param compressionMethod 压缩方式
+ * @param estimatedSize 预计的分卷size，用来预先分配磁盘空间
+ * @param volume 卷号
+ * @return 函数执行结果
+ */
+static bool CreateVolumeFile(PackWriter &writer, const std::string &path, int compressionMethod, uint64_t estimatedSize, uint32_t volume)
+{
+    if (!writer.Open(path)) return false;
+
+    writer.Preallocate(estimatedSize);
+
+    uint8_t magic[] = {0x50, 0x41, 0x43, 0x75};
+    uint32_t entryCount = 0;
+    VolumeTag tag = MakeVolumeTag(0, volume);
+
+    writer.Write(magic, 4);
+    writer.Write(&entryCount, 4);
+    writer.Write(&compressionMethod, 4);
+
+    return writer.Write(&tag, sizeof(tag));
+}
+
+/**
+ * @brief 根据所有分卷的索引生成封包的标识
+ *
+ * 相同的输入总是得到相同的标识，封包的内容可以重现；内容不同的封包标识几乎不会相同
+ *
+ * @param volumeIndexes 每个分卷的文件索引
+ * @return 封包的标识
+ */
+static uint32_t GetPackageId(const std::vector<std::vector<PackageEntry>> &volumeIndexes)
+{
+    XXHash64 hash;
+
+    for (const auto &entries : volumeIndexes)
+    {
+        uint32_t entryCount = (uint32_t)entries.size();
+
+        hash.Update(&entryCount, 4);
+
+        if (entryCount) hash.Update(entries.data(), sizeof(PackageEntry) * entryCount);
+    }
+
+    return (uint32_t)hash.Digest();
+}
+
+/**
+ * @brief 在分卷末尾写入索引，然后回去更新文件数量、封包标识和分卷数量
+ *
+ * @param path 分卷路径
+ * @param entries 这个分卷的文件索引
+ * @param packageId 封包的标识，所有分卷相同
+ * @param volumeCount 封包的分卷数量
+ * @return 函数执行结果
+ */
+static bool WriteVolumeIndex(const std::string &path, std::vector<PackageEntry> &entries, uint32_t packageId, uint32_t volumeCount)
+{
+    PackWriter writer;
+
+    if (!writer.Open(path, true, 64 * 1024)) return false;
+
+    uint32_t entryCount = (uint32_t)entries.size();
+
+    uint8_t* const index = reinterpret_cast<uint8_t*>(entries.data());
+    auto indexSize = sizeof(PackageEntry) * entryCount;
+
+    // 压缩索引，没有文件时索引为空
+    std::vector<uint8_t> compressedIndex;
+
+    if (entryCount)
+    {
+        HuffmanEncoder huffmanEncoder;
+        compressedIndex = huffmanEncoder.Encode(index, indexSize);
+    }
+
+    uint32_t compressedIndexSize = compressedIndex.size();
+
+    // 加密
+    for (uint32_t i = 0; i < compressedIndexSize; i++)
+    {
+        compressedIndex[i] = ~compressedIndex[i];
+    }
+
+    writer.Write(compressedIndex.data(), compressedIndexSize);
+    writer.Write(&compressedIndexSize, 4);
+
+    // 回去更新文件数量、封包标识和分卷数量
+    writer.WriteAt(4, &entryCount, 4);
+    writer.WriteAt(12 + offsetof(VolumeTag, PackageId), &packageId, 4);
+    writer.WriteAt(12 + offsetof(VolumeTag, VolumeCount), &volumeCount, 4);
+
+    return writer.Close();
+}
+
+/**
+ * @brief 乱序写入
+ *
+ * 每个线程取一个文件压缩，压缩完立即在输出末尾预留空间直接写入，不等待其他线程。
+ * 索引写在和源文件顺序对应的位置，最后去掉失败的文件，所以只有数据的排列顺序不固定
+ *
+ * @param files 要写入的文件
+ * @param state 封包状态
+ * @param writer 输出，已经写入文件头
+ * @param[out] entries 索引，和files一样大
+ * @param[out] checksums 校验信息，为空时不输出
+ * @param[out] payloadBytes 写入的数据size
+ * @param[out] paddingBytes 对齐填充的size
+ * @return 写入的文件数量
+ */
+static uint32_t PackUnordered(std::vector<PackItem> &files, PackState &state, PackWriter &writer, std::vector<PackageEntry> &entries,
+                              std::vector<ChecksumEntry> &checksums, uint64_t &payloadBytes, uint64_t &paddingBytes)
+{
+    const uint64_t align = state.Options->Align > 1 ? state.Options->Align : 1;
+    const bool writeChecksum = !checksums.empty();
+
+    // 索引在数据后面，所有数据加上索引不能超过4GB
+    const uint64_t limit = UINT32_MAX - GetIndexReserve((uint32_t)files.size());
+
+    // 第一个文件的起始位置也要对齐，之后每个文件预留的空间都是align的倍数
+    const std::vector<uint8_t> alignPadding((size_t)align - 1, 0);
+    const uint64_t headerPadding = (align - writer.GetOffset() % align) % align;
+
+    if (headerPadding) writer.Write(alignPadding.data(), (size_t)headerPadding);
+
+    if (!writer.Flush()) return 0;
+
+    std::vector<uint8_t> written(files.size(), 0);  // 每个文件是否写入成功
+    std::atomic<size_t> next{0};
+    std::atomic<uint64_t> totalPayload{0};
+    std::atomic<uint64_t> totalPadding{headerPadding};
+
+    auto addEntry = [&](size_t k, const FileData &result, uint64_t offset)
+    {
+        auto &entry = entries[k];
+
+        strcpy_s(entry.Name, result.Name.c_str());
+        entry.Position = (uint32_t)offset;
+        entry.OriginalSize = result.OriginalSize;
+        entry.CompressedSize = result.CompressedSize;
+
+        if (writeChecksum)
+        {
+            auto &checksum = checksums[k];
+
+            memcpy(checksum.Name, entry.Name, sizeof(entry.Name));
+            checksum.OriginalSize = entry.OriginalSize;
+            checksum.CompressedSize = entry.CompressedSize;
+            checksum.ModifyTime = result.ModifyTime;
+            checksum.OriginalHash = result.OriginalHash;
+            checksum.CompressedHash = result.CompressedHash;
+        }
+
+        written[k] = 1;
+    };
+
+    auto worker = [&]()
+    {
+        size_t k;
+
+        while ((k = next++) < files.size())
+        {
+            auto result = ProcessFile(files[k], &state);
+
+            if (result.Data.empty() && !result.Streamed) continue; // 读取或者压缩失败了
+
+            // 大文件已经压缩到临时文件，size是确定的，和其他文件一样预留空间
+            uint64_t size = result.Streamed ? result.CompressedSize : result.Data.size();
+            uint64_t reserved = (size + align - 1) / align * align;
+            uint64_t offset;
+
+            if (!writer.Reserve(reserved, limit, offset))
+            {
+                printf("ERROR: Skipped '%s', the package would be larger than 4 GB.\n", result.Name.c_str());
+                continue;
+            }
+
+            if (result.Streamed)
+            {
+                uint64_t copied = 0;
+
+                auto output = [&](const uint8_t *data, size_t chunk)
+                {
+                    bool ok = writer.WriteReserved(offset + copied, data, chunk);
+                    copied += chunk;
+                    return ok;
+                };
+
+                if (!WriteStreamedFile(result, &state, output)) continue;
+            }
+            else if (!writer.WriteReserved(offset, result.Data.data(), size))
+            {
+                continue;
+            }
+
+            addEntry(k, result, offset);
+
+            totalPayload += size;
+            totalPadding += reserved - size;
+        }
+    };
+
+    uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (uint32_t n = 1; n < threadCount; n++) threads.emplace_back(worker);
+
+    worker();
+
+    for (auto &thread : threads) thread.join();
+
+    // 去掉失败的文件
+    uint32_t count = 0;
+
+    for (size_t k = 0; k < files.size(); k++)
+    {
+        if (!written[k]) continue;
+
+        entries[count] = entries[k];
+
+        if (writeChecksum) checksums[count] = checksums[k];
+
+        count++;
+    }
+
+    payloadBytes = totalPayload;
+    paddingBytes = totalPadding;
+
+    return count;
+}
+
+/**
+ * @brief 多线程压缩
+ * 
+ * @param pacPath 要写入的目标封包
+ * @param dirPath 源文件夹，以@开头时为清单文件，按清单的顺序写入
+ * @param compressionMethod 压缩方式 
+ * @param options 封包选项
+ * @return 函数执行结果
+ */
+bool CreatePackageMT(const std::string &pacPath, const std::string &dirPath, int compressionMethod,int codePage, const PackOptions &requestedOptions)
+{
+    auto tp1 = steady_clock::now();
+
+    PackOptions options = requestedOptions;
+
+    // 乱序写入时没有按顺序写入的地方，不能去重和分卷
+    if (options.Unordered && options.Dedup)
+    {
+        printf("WARNING: --dedup is ignored with --unordered.\n");
+        options.Dedup = false;
+    }
+
+    if (options.Unordered && options.VolumeSize != UINT32_MAX)
+    {
+        printf("WARNING: --volume-size is ignored with --unordered.\n");
+        options.VolumeSize = UINT32_MAX;
+    }
+
+    std::vector<PackItem> files;
+
+    if (!CollectPackItems(dirPath, compressionMethod, files)) return false;
+
+    // 按访问记录排列写入顺序
+    if (!options.LayoutPath.empty())
+    {
+        std::vector<std::string> names;
+        names.reserve(files.size());
+
+        for (const auto &item : files) names.emplace_back(GetEntryName(item, codePage));
+
+        if (!ApplyAccessLayout(options.LayoutPath, files, names)) return false;
+    }
+
+    if (files.empty())
+    {
+        printf("ERROR: No any files to pack.");
+        return false;
+    }
+
+    PackState state;
+    state.Options = &options;
+    state.CompressionMethod = compressionMethod;
+    state.CodePage = codePage;
+
+    if (!options.CacheDir.empty())
+    {
+        state.Cache.reset(new CompressCache(options.CacheDir, options.CacheSize));
+
+        if (!state.Cache->Open()) state.Cache.reset();
+    }
+
+    // 基准封包可能就是输出的封包，所以先写到临时文件，最后再替换
+    bool incremental = !options.BasePath.empty() && OpenBasePackage(state);
+    bool writeChecksum = options.WriteChecksum || !options.BasePath.empty();
+
+    auto getOutputPath = [&pacPath, incremental](uint32_t volume)
+    {
+        auto path = GetVolumePath(pacPath, volume);
+        return incremental ? path + ".tmp" : path;
+    };
+
+    state.SpillPrefix = getOutputPath(0) + ".stream";
+
+    // 写入之前记下上一次封包的分卷，只删除确实属于它的分卷
+    const auto oldVolumePaths = FindVolumePaths(pacPath);
+
+    // 创建索引数据块，内存连续
+    std::vector<PackageEntry> entries;
+    entries.resize(files.size());
+
+    std::vector<uint32_t> entryVolumes;     // 每个文件所在的分卷
+    entryVolumes.resize(files.size());
+
+    std::vector<ChecksumEntry> checksums;
+
+    if (writeChecksum) checksums.resize(files.size());
+
+    // 分卷: 偏移是uint32_t，所以每个分卷不能超过4GB，超过VolumeSize之前换到下一个分卷
+    const uint64_t volumeLimit = std::min<uint64_t>(options.VolumeSize, UINT32_MAX);
+    std::vector<uint64_t> volumeSizes;          // 每个分卷的数据size，包括文件头
+    std::vector<uint32_t> volumeEntryCounts;    // 每个分卷的文件数量，用来预留索引的空间
+
+    printf("Total %d files to pack.\n", files.size());
+
+    uint64_t totalInputBytes = 0;       // 所有源文件的size，用来估计还要写入多少数据
+    uint64_t processedInputBytes = 0;
+    uint64_t writtenInputBytes = 0;     // 已经写入的数据压缩前的size
+
+    for (const auto &item : files) totalInputBytes += item.File.Size;
+
+    // 写入缓冲在大缓冲区里合并，当前分卷写满之后关闭，最后再打开写入索引
+    PackWriter writer(options.Io == IoMode::Async);
+
+    // 还没有压缩率时按源文件的size预先分配，多分配的空间关闭时会释放
+    if (!CreateVolumeFile(writer, getOutputPath(0), compressionMethod,
+                          std::min(volumeLimit, PackageHeaderSize + totalInputBytes + GetIndexReserve((uint32_t)files.size())), 0))
+    {
+        return false;
+    }
+
+    volumeSizes.emplace_back(PackageHeaderSize);
+    volumeEntryCounts.emplace_back(0);
+
+    // 实际处理了的文件数量
+    uint32_t i = 0;
+
+    // 取CPU线程数量
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+
+    std::vector<std::future<FileData>> tasks;  //任务池
+    tasks.reserve(maxThreads);
+
+    // 去重: 已经写入的内容对应的索引，以及等待相同内容写入的索引
+    std::unordered_map<ContentKey, uint32_t, ContentKeyHasher> writtenContents;
+    std::unordered_map<ContentKey, std::vector<uint32_t>, ContentKeyHasher> pendingDuplicates;
+    uint32_t dedupCount = 0;
+    uint64_t dedupBytes = 0;
+
+    // 对齐时填充的0
+    const std::vector<uint8_t> alignPadding(options.Align > 1 ? options.Align - 1 : 0, 0);
+    uint64_t paddingBytes = 0;
+    uint64_t payloadBytes = 0;
+
+    auto getPadding = [&options, &alignPadding](uint64_t offset) -> uint32_t
+    {
+        return alignPadding.empty() ? 0 : (uint32_t)((options.Align - offset % options.Align) % options.Align);
+    };
+
+    // 分卷里再加一个文件之后索引是否还放得下
+    auto canAddEntry = [&](uint32_t volume)
+    {
+        return volumeSizes[volume] + GetIndexReserve(volumeEntryCounts[volume] + 1) <= volumeLimit;
+    };
+
+    if (options.Unordered)
+    {
+        i = PackUnordered(files, state, writer, entries, checksums, payloadBytes, paddingBytes);
+
+        volumeSizes[0] = writer.GetOffset();
+        volumeEntryCounts[0] = i;
+    }
+    else
+    {
+        size_t next = 0;    // 下一个要处理的文件
+
+        while (next < files.size())
+        {
+            // 创建线程并行读取和压缩
+
+            tasks.clear();
+
+            for (uint32_t n = 0; n < maxThreads; n++)
+            {
+                if (next >= files.size())
+                    break;
+
+                // 取出一个文件然后创建线程来读取
+                auto task = std::async(std::launch::async, ProcessFile, std::move(files[next++]), &state);    //std::launch::async 强制创建新线程执行
+                tasks.emplace_back(std::move(task));
+            }
+
+            // 获取文件数据
+
+            for (auto &task : tasks)
+            {
+                auto result = task.get();
+
+                processedInputBytes += result.OriginalSize;
+
+                if (result.Data.empty() && !result.Duplicate && !result.Streamed)
+                    continue; // 读取或者压缩失败了
+
+                auto &entry = entries[i];
+
+                strcpy_s(entry.Name, result.Name.c_str());
+                entry.OriginalSize = result.OriginalSize;
+
+                ContentKey key = {result.OriginalHash, result.OriginalSize};
+                auto written = options.Dedup && !result.Streamed ? writtenContents.find(key) : writtenContents.end();
+
+                if (written != writtenContents.end())
+                {
+                    // 和已经写入的文件内容相同，直接指向同一份数据，索引放在数据所在的分卷
+                    uint32_t volume = entryVolumes[written->second];
+
+                    if (!canAddEntry(volume))
+                    {
+                        printf("ERROR: Skipped '%s', no space left for its index in volume %u.\n", entry.Name, volume);
+                        continue;
+                    }
+
+                    entry.Position = entries[written->second].Position;
+                    entry.CompressedSize = entries[written->second].CompressedSize;
+                    entryVolumes[i] = volume;
+
+                    if (writeChecksum) result.CompressedHash = checksums[written->second].CompressedHash;
+                    volumeEntryCounts[volume]++;
+
+                    dedupCount++;
+                    dedupBytes += entry.CompressedSize;
+                }
+                else if (result.Duplicate)
+                {
+                    // 相同内容的文件还没有写入，写入之后再补上
+                    entry.Position = 0;
+                    entry.CompressedSize = 0;
+                    pendingDuplicates[key].emplace_back(i);
+                }
+                else
+                {
+                    // 分块压缩的文件已经压缩到临时文件，size是确定的
+                    uint64_t size = result.Streamed ? result.CompressedSize : result.Data.size();
+                    uint32_t volume = (uint32_t)volumeSizes.size() - 1;
+                    uint64_t offset = volumeSizes[volume];
+
+                    // 等待这份数据的重复文件的索引也放在同一个分卷里，一起算进索引的空间
+                    uint32_t newEntries = 1;
+
+                    if (options.Dedup && !result.Streamed)
+                    {
+                        auto pending = pendingDuplicates.find(key);
+
+                        if (pending != pendingDuplicates.end()) newEntries += (uint32_t)pending->second.size();
+                    }
+
+                    // 当前分卷放不下，或者为了让各个分卷的size接近，换到下一个分卷
+                    if (volumeEntryCounts[volume] > 0)
+                    {
+                        bool full = offset + getPadding(offset) + size + GetIndexReserve(volumeEntryCounts[volume] + newEntries) > volumeLimit;
+                        bool balanced = false;
+
+                        // 按目前的压缩率估计剩下的数据
+                        double ratio = writtenInputBytes ? (double)payloadBytes / writtenInputBytes : 1.0;
+                        uint64_t pendingBytes = size + (uint64_t)((totalInputBytes - processedInputBytes) * ratio);
+
+                        if (!full)
+                        {
+                            // 平均分到还需要的分卷里
+                            uint64_t remaining = offset - PackageHeaderSize + pendingBytes;
+                            uint64_t usable = volumeLimit - PackageHeaderSize - GetIndexReserve(volumeEntryCounts[volume] + newEntries);
+                            uint64_t volumesLeft = (remaining + usable - 1) / usable;
+
+                            balanced = volumesLeft > 1 && offset - PackageHeaderSize + size > remaining / volumesLeft;
+                        }
+
+                        if (full || balanced)
+                        {
+                            if (!writer.Close()) return false;
+
+                            volume++;
+
+                            if (!CreateVolumeFile(writer, getOutputPath(volume), compressionMethod,
+                                                  std::min(volumeLimit, PackageHeaderSize + pendingBytes + GetIndexReserve((uint32_t)(files.size() - i))),
+                                                  volume))
+                            {
+                                return false;
+                            }
+
+                            volumeSizes.emplace_back(PackageHeaderSize);
+                            volumeEntryCounts.emplace_back(0);
+                            offset = PackageHeaderSize;
+                        }
+                    }
+
+                    uint32_t padding = getPadding(offset);
+
+                    if (offset + padding + size + GetIndexReserve(volumeEntryCounts[volume] + newEntries) > volumeLimit)
+                    {
+                        printf("ERROR: Skipped '%s', it is too large for a volume.\n", entry.Name);
+                        continue;
+                    }
+
+                    // 数据的起始位置对齐到options.Align
+                    if (padding)
+                    {
+                        writer.Write(alignPadding.data(), padding);
+
+                        paddingBytes += padding;
+                        offset += padding;
+                    }
+
+                    if (result.Streamed)
+                    {
+                        auto output = [&writer](const uint8_t *data, size_t chunk) { return writer.Write(data, chunk); };
+
+                        // 失败时连同对齐填充一起丢弃，下一个文件从原来的位置开始
+                        if (!WriteStreamedFile(result, &state, output))
+                        {
+                            writer.Rewind(offset - padding);
+                            paddingBytes -= padding;
+                            continue;
+                        }
+                    }
+                    else if (!writer.Write(result.Data.data(), size))
+                    {
+                        return false;
+                    }
+
+                    entry.Position = (uint32_t)offset;
+                    entry.CompressedSize = result.CompressedSize;
+                    entryVolumes[i] = volume;
+
+                    volumeSizes[volume] = offset + size;
+                    volumeEntryCounts[volume]++;
+                    payloadBytes += size;
+                    writtenInputBytes += result.OriginalSize;
+
+                    if (options.Dedup && !result.Streamed)
+                    {
+                        writtenContents.emplace(key, i);
+
+                        auto pending = pendingDuplicates.find(key);
+
+                        if (pending != pendingDuplicates.end())
+                        {
+                            for (uint32_t j : pending->second)
+                            {
+                                entries[j].Position = entry.Position;
+                                entries[j].CompressedSize = entry.CompressedSize;
+                                entryVolumes[j] = volume;
+                                volumeEntryCounts[volume]++;
+
+                                if (writeChecksum)
+                                {
+                                    checksums[j].CompressedSize = entry.CompressedSize;
+                                    checksums[j].CompressedHash = result.CompressedHash;
+                                }
+
+                                dedupCount++;
+                                dedupBytes += entry.CompressedSize;
+                            }
+
+                            pendingDuplicates.erase(pending);
+                        }
+                    }
+                }
+
+                if (writeChecksum)
+                {
+                    auto &checksum = checksums[i];
+
+                    memcpy(checksum.Name, entry.Name, sizeof(entry.Name));
+                    checksum.OriginalSize = entry.OriginalSize;
+                    checksum.CompressedSize = entry.CompressedSize;
+                    checksum.ModifyTime = result.ModifyTime;
+                    checksum.OriginalHash = result.OriginalHash;
+                    checksum.CompressedHash = result.CompressedHash;
+                }
+
+                i++;
+            }
+        }
+    }
+
+    if (!writer.Close()) return false;
+
+    // 负责压缩的文件失败了，和它内容相同的文件也只能跳过
+    if (!pendingDuplicates.empty())
+    {
+        std::vector<bool> dropped(i, false);
+
+        for (const auto &pending : pendingDuplicates)
+        {
+            for (uint32_t j : pending.second)
+            {
+                printf("ERROR: Skipped '%s', the file with the same content failed.\n", entries[j].Name);
+                dropped[j] = true;
+            }
+        }
+
+        uint32_t kept = 0;
+
+        for (uint32_t j = 0; j < i; j++)
+        {
+            if (dropped[j]) continue;
+
+            entries[kept] = entries[j];
+            entryVolumes[kept] = entryVolumes[j];
+
+            if (writeChecksum) checksums[kept] = checksums[j];
+
+            kept++;
+        }
+
+        i = kept;
+    }
+
+    uint32_t entryCount = i;
+    uint32_t volumeCount = (uint32_t)volumeSizes.size();
+
+    // 索引按文件名排序，.sum跟着一起排序
+    if (options.SortIndex)
+    {
+        std::vector<uint32_t> order(entryCount);
+
+        for (uint32_t j = 0; j < entryCount; j++) order[j] = j;
+
+        std::stable_sort(order.begin(), order.end(), [&entries](uint32_t a, uint32_t b)
+                         { return _stricmp(entries[a].Name, entries[b].Name) < 0; });
+
+        std::vector<PackageEntry> sortedEntries(entryCount);
+        std::vector<uint32_t> sortedVolumes(entryCount);
+        std::vector<ChecksumEntry> sortedChecksums(writeChecksum ? entryCount : 0);
+
+        for (uint32_t j = 0; j < entryCount; j++)
+        {
+            sortedEntries[j] = entries[order[j]];
+            sortedVolumes[j] = entryVolumes[order[j]];
+
+            if (writeChecksum) sortedChecksums[j] = checksums[order[j]];
+        }
+
+        entries.swap(sortedEntries);
+        entryVolumes.swap(sortedVolumes);
+
+        if (writeChecksum) checksums.swap(sortedChecksums);
+    }
+
+    // 按分卷分组写入索引，.sum的顺序和读取时所有分卷连续编号的顺序相同
+    std::vector<std::vector<PackageEntry>> volumeIndexes(volumeCount);
+    std::vector<ChecksumEntry> volumeChecksums;
+
+    for (uint32_t j = 0; j < entryCount; j++) volumeIndexes[entryVolumes[j]].emplace_back(entries[j]);
+
+    if (writeChecksum)
+    {
+        volumeChecksums.reserve(entryCount);
+
+        for (uint32_t volume = 0; volume < volumeCount; volume++)
+        {
+            for (uint32_t j = 0; j < entryCount; j++)
+            {
+                if (entryVolumes[j] == volume) volumeChecksums.emplace_back(checksums[j]);
+            }
+        }
+
+        checksums.swap(volumeChecksums);
+    }
+
+    const uint32_t packageId = GetPackageId(volumeIndexes);
+
+    for (uint32_t volume = 0; volume < volumeCount; volume++)
+    {
+        if (!WriteVolumeIndex(getOutputPath(volume), volumeIndexes[volume], packageId, volumeCount)) return false;
+    }
+
+    if (incremental)
+    {
+        // 替换之前要关闭基准封包
+        state.BaseReader.Close();
+
+        for (uint32_t volume = 0; volume < volumeCount; volume++)
+        {
+            if (!MoveFileExA(getOutputPath(volume).c_str(), GetVolumePath(pacPath, volume).c_str(), MOVEFILE_REPLACE_EXISTING))
+            {
+                printf("ERROR: Failed to replace package file.");
+                return false;
+            }
+        }
+
+        printf("Reused %u files (%.2f MB) from base package.\n", state.ReusedCount.load(), state.ReusedBytes / 1048576.0);
+    }
+
+    // 删除上一次封包多出来的分卷
+    for (size_t volume = volumeCount; volume < oldVolumePaths.size(); volume++)
+    {
+        DeleteFileA(oldVolumePaths[volume].c_str());
+        DeleteFileA(GetIndexCachePath(oldVolumePaths[volume]).c_str());
+        printf("Removed stale volume '%s'.\n", oldVolumePaths[volume].c_str());
+    }
+
+    if (volumeCount > 1)
+    {
+        printf("Split into %u volumes:\n", volumeCount);
+
+        for (uint32_t volume = 0; volume < volumeCount; volume++)
+        {
+            printf("  %s: %u files, %.2f MB\n", GetVolumePath(pacPath, volume).c_str(), (uint32_t)volumeIndexes[volume].size(),
+                   volumeSizes[volume] / 1048576.0);
+        }
+    }
+
+    if (options.Align > 1)
+    {
+        printf("Aligned payloads to %u bytes, padding %.2f MB (%.2f%% of %.2f MB payload).\n", options.Align, paddingBytes / 1048576.0,
+               payloadBytes ? paddingBytes * 100.0 / payloadBytes : 0.0, payloadBytes / 1048576.0);
+    }
+
+    if (compressionMethod == 4 || compressionMethod == 7)
+    {
+        printf("Stored %u files (%.2f MB) without compression.\n", state.StoredCount.load(), state.StoredBytes / 1048576.0);
+    }
+
+    if (options.Dedup)
+    {
+        printf("Deduplicated %u files, saved %.2f MB of output and skipped compressing %.2f MB.\n", dedupCount,
+               dedupBytes / 1048576.0, state.DedupSkippedBytes / 1048576.0);
+    }
+
+    if (state.Cache)
+    {
+        state.Cache->Trim();
+        state.Cache->PrintStats();
+    }
+
+    if (writeChecksum)
+    {
+        checksums.resize(entryCount);
+
+        if (!WriteChecksumFile(pacPath, checksums))
+        {
+            printf("WARNING: Failed to write checksum file.\n");
+        }
+    }
+    else
+    {
+        // 上次封包的.sum已经和新的封包对不上了
+        DeleteFileA(GetChecksumPath(pacPath).c_str());
+    }
+
+    // 分卷都写完并替换之后才能记录修改时间
+    if (options.WriteIndexCache)
+    {
+        for (uint32_t volume = 0; volume < volumeCount; volume++)
+        {
+            auto volumePath = GetVolumePath(pacPath, volume);
+
+            if (!IndexCache::Write(volumePath, compressionMethod, volumeIndexes[volume]))
+            {
+                printf("WARNING: Failed to write index cache '%s'.\n", GetIndexCachePath(volumePath).c_str());
+            }
+        }
+    }
+
+    auto tp2 = steady_clock::now();
+
+    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+
+    printf("[MT] Packed %d files in %llu ms.\n", entryCount, ms);
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////
+// 转码
+//////////////////////////////////////////////////////////////////
+
+/**
+ * @brief 转码时各线程共享的状态
+ */
+struct TranscodeState
+{
+    const PackOptions *Options = nullptr;
+    const PackageReader *Reader = nullptr;
+    int CompressionMethod = 0;
+    int Level = 0;
+
+    std::atomic<uint32_t> StoredCount{0};     // 直接复制或者压缩不了直接存储的文件
+    std::atomic<uint64_t> StoredBytes{0};
+};
+
+/**
+ * @brief 转码一个文件
+ *
+ * 源封包压缩过并且这个文件压缩不了直接存储的，原样复制；
+ * 其他文件(包括不压缩的源封包里的所有文件)解压后和封包时一样先抽样判断，
+ * 再用新的压缩方式和等级重新压缩，没有变小时直接存储
+ *
+ * @param index 源封包里的文件index
+ * @param state 转码状态
+ * @return FileData 写入封包需要的信息，失败时Name为空
+ */
+static FileData TranscodeEntry(uint32_t index, TranscodeState *state)
+{
+    const auto &reader = *state->Reader;
+    const auto &entry = reader.GetEntry(index);
+    const bool writeChecksum = state->Options->WriteChecksum;
+
+    FileData fileData;
+    std::string name(entry.Name, strnlen(entry.Name, sizeof(entry.Name)));
+
+    std::vector<uint8_t> data;
+
+    // 不压缩的源封包里每个文件都是直接存储的，不能说明压缩不了
+    const uint32_t sourceMethod = reader.GetCompressionMethod();
+
+    if ((sourceMethod == 4 || sourceMethod == 7) && entry.OriginalSize == entry.CompressedSize)
+    {
+        if (!reader.ReadRaw(index, data))
+        {
+            printf("ERROR: Failed to read '%s'.\n", name.c_str());
+            return {};
+        }
+
+        state->StoredCount++;
+        state->StoredBytes += data.size();
+
+        fileData.OriginalSize = (uint32_t)data.size();
+        fileData.CompressedSize = fileData.OriginalSize;
+
+        if (writeChecksum) fileData.OriginalHash = fileData.CompressedHash = XXHash64::Compute(data.data(), data.size());
+
+        fileData.Data = std::move(data);
+        fileData.Name = std::move(name);
+        return fileData;
+    }
+
+    // 解压失败时PackageReader已经输出了错误
+    if (!reader.Read(index, data)) return {};
+
+    fileData.OriginalSize = (uint32_t)data.size();
+
+    if (writeChecksum) fileData.OriginalHash = XXHash64::Compute(data.data(), data.size());
+
+    std::vector<uint8_t> compressedData;
+
+    // 抽样判断压缩不了的不用压缩，直接存储
+    bool compress = (state->CompressionMethod == 4 || state->CompressionMethod == 7) &&
+                    !ShouldStoreFile(name, state->CompressionMethod, data.data(), data.size(), *state->Options);
+
+    if (compress && !CompressData(state->CompressionMethod, state->Level, data.data(), data.size(), compressedData))
+    {
+        printf("ERROR: Failed to compress '%s' with %s.\n", name.c_str(), GetCompressionName(state->CompressionMethod));
+        return {};
+    }
+
+    // 不压缩的封包，抽样判断压缩不了，或者压缩后没有变小的直接存储
+    if (compressedData.empty() || compressedData.size() >= data.size())
+    {
+        state->StoredCount++;
+        state->StoredBytes += data.size();
+
+        fileData.CompressedSize = fileData.OriginalSize;
+        fileData.CompressedHash = fileData.OriginalHash;
+        fileData.Data = std::move(data);
+    }
+    else
+    {
+        fileData.CompressedSize = (uint32_t)compressedData.size();
+
+        if (writeChecksum) fileData.CompressedHash = XXHash64::Compute(compressedData.data(), compressedData.size());
+
+        fileData.Data = std::move(compressedData);
+    }
+
+    fileData.Name = std::move(name);
+
+    return fileData;
+}
+
+/**
+ * @brief 把封包转换成另一种压缩方式或者压缩等级，不经过磁盘上的中间文件
+ *
+ * 多个线程同时解压和重新压缩，按原来的顺序写入，文件名、顺序和分卷都和源封包相同，
+ * 指向同一份数据的文件仍然共享数据。先写到临时文件，全部成功之后再替换，所以输出可以就是源封包
+ *
+ * @param srcPath 源封包路径，分卷时为第一卷
+ * @param pacPath 输出封包路径
+ * @param compressionMethod 新的压缩方式
+ * @param options 使用其中的压缩等级、.sum、.idx和写入方式
+ * @return 函数执行结果
+ */
+bool TranscodePackage(const std::string &srcPath, const std::string &pacPath, int compressionMethod, const PackOptions &options)
+{
+    auto tp1 = steady_clock::now();
+
+    // 输出可能就是源封包，打开之前记下输出路径上的分卷
+    const auto oldVolumePaths = FindVolumePaths(pacPath);
+
+    PackageReader reader;
+
+    if (!reader.Open(srcPath)) return false;
+
+    TranscodeState state;
+    state.Options = &options;
+    state.Reader = &reader;
+    state.CompressionMethod = compressionMethod;
+    state.Level = options.HasLevel ? options.Level : GetDefaultCompressionLevel(compressionMethod);
+
+    const uint32_t entryCount = reader.GetEntryCount();
+    const uint32_t volumeCount = reader.GetVolumeCount();
+
+    printf("Transcoding %u files from %s to %s.\n", entryCount, GetCompressionName(reader.GetCompressionMethod()),
+           GetCompressionName(compressionMethod));
+
+    // 源文件的修改时间只在源封包的.sum里有，留给之后的增量封包使用
+    std::vector<ChecksumEntry> sourceChecksums;
+
+    if (options.WriteChecksum && (!ReadPackageChecksums(srcPath, sourceChecksums) || sourceChecksums.size() != entryCount))
+    {
+        sourceChecksums.clear();
+    }
+
+    std::vector<PackageEntry> entries(entryCount);
+    std::vector<ChecksumEntry> checksums(options.WriteChecksum ? entryCount : 0);
+    std::vector<std::vector<PackageEntry>> volumeIndexes(volumeCount);
+
+    auto getOutputPath = [&pacPath](uint32_t volume)
+    {
+        return GetVolumePath(pacPath, volume) + ".tmp";
+    };
+
+    auto removeOutput = [&getOutputPath, volumeCount]()
+    {
+        for (uint32_t volume = 0; volume < volumeCount; volume++) DeleteFileA(getOutputPath(volume).c_str());
+    };
+
+    // 取CPU线程数量
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+
+    std::vector<uint32_t> batch;
+    std::vector<std::future<FileData>> tasks;  //任务池，共享数据的文件没有任务
+    batch.reserve(maxThreads);
+    tasks.reserve(maxThreads);
+
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    uint32_t sharedCount = 0;
+    uint32_t first = 0;     // 当前分卷的第一个文件
+
+    for (uint32_t volume = 0; volume < volumeCount; volume++)
+    {
+        uint32_t end = first;
+        uint64_t estimatedSize = PackageHeaderSize;
+
+        for (; end < entryCount && reader.GetEntryVolume(end) == volume; end++) estimatedSize += reader.GetEntry(end).CompressedSize;
+
+        PackWriter writer(options.Io == IoMode::Async);
+
+        // 按源分卷的size预先分配，多分配的空间关闭时会释放
+        if (!CreateVolumeFile(writer, getOutputPath(volume), compressionMethod,
+                              std::min<uint64_t>(UINT32_MAX, estimatedSize + GetIndexReserve(end - first)), volume))
+        {
+            removeOutput();
+            return false;
+        }
+
+        uint64_t offset = PackageHeaderSize;
+
+        // 源分卷里数据的位置和size对应的第一个文件，用来保留共享的数据
+        std::unordered_map<uint64_t, uint32_t> sourceData;
+
+        for (uint32_t next = first; next < end;)
+        {
+            batch.clear();
+            tasks.clear();
+
+            while (batch.size() < maxThreads && next < end)
+            {
+                const auto &entry = reader.GetEntry(next);
+                uint64_t key = (uint64_t)entry.Position << 32 | entry.CompressedSize;
+
+                // 和前面的文件指向同一份数据时不用再转码，写入时指向同一位置
+                if (sourceData.emplace(key, next).second)
+                    tasks.emplace_back(std::async(std::launch::async, TranscodeEntry, next, &state));
+                else
+                    tasks.emplace_back();
+
+                batch.emplace_back(next++);
+            }
+
+            for (size_t n = 0; n < batch.size(); n++)
+            {
+                uint32_t index = batch[n];
+                const auto &sourceEntry = reader.GetEntry(index);
+                auto &entry = entries[index];
+
+                memcpy(entry.Name, sourceEntry.Name, sizeof(entry.Name));
+
+                if (!tasks[n].valid())
+                {
+                    uint32_t source = sourceData[(uint64_t)sourceEntry.Position << 32 | sourceEntry.CompressedSize];
+
+                    entry.Position = entries[source].Position;
+                    entry.OriginalSize = entries[source].OriginalSize;
+                    entry.CompressedSize = entries[source].CompressedSize;
+
+                    if (options.WriteChecksum)
+                    {
+                        checksums[index].OriginalHash = checksums[source].OriginalHash;
+                        checksums[index].CompressedHash = checksums[source].CompressedHash;
+                    }
+
+                    sharedCount++;
+                }
+                else
+                {
+                    auto result = tasks[n].get();
+
+                    // 源封包读不出来或者压缩失败时不输出不完整的封包
+                    if (result.Name.empty())
+                    {
+                        writer.Close();
+                        removeOutput();
+                        return false;
+                    }
+
+                    if (offset + result.Data.size() + GetIndexReserve(end - first) > UINT32_MAX)
+                    {
+                        printf("ERROR: '%s' does not fit in volume %u after transcoding.\n", result.Name.c_str(), volume);
+                        writer.Close();
+                        removeOutput();
+                        return false;
+                    }
+
+                    if (!writer.Write(result.Data.data(), result.Data.size()))
+                    {
+                        writer.Close();
+                        removeOutput();
+                        return false;
+                    }
+
+                    entry.Position = (uint32_t)offset;
+                    entry.OriginalSize = result.OriginalSize;
+                    entry.CompressedSize = result.CompressedSize;
+
+                    offset += result.Data.size();
+                    inputBytes += sourceEntry.CompressedSize;
+                    outputBytes += result.Data.size();
+
+                    if (options.WriteChecksum)
+                    {
+                        checksums[index].OriginalHash = result.OriginalHash;
+                        checksums[index].CompressedHash = result.CompressedHash;
+                    }
+                }
+
+                if (options.WriteChecksum)
+                {
+                    auto &checksum = checksums[index];
+
+                    memcpy(checksum.Name, entry.Name, sizeof(entry.Name));
+                    checksum.OriginalSize = entry.OriginalSize;
+                    checksum.CompressedSize = entry.CompressedSize;
+
+                    if (!sourceChecksums.empty() && memcmp(sourceChecksums[index].Name, entry.Name, sizeof(entry.Name)) == 0)
+                    {
+                        checksum.ModifyTime = sourceChecksums[index].ModifyTime;
+                    }
+                }
+            }
+        }
+
+        if (!writer.Close())
+        {
+            removeOutput();
+            return false;
+        }
+
+        volumeIndexes[volume].assign(entries.begin() + first, entries.begin() + end);
+
+        first = end;
+    }
+
+    // 所有分卷的索引都确定之后才能生成封包标识
+    const uint32_t packageId = GetPackageId(volumeIndexes);
+
+    for (uint32_t volume = 0; volume < volumeCount; volume++)
+    {
+        if (!WriteVolumeIndex(getOutputPath(volume), volumeIndexes[volume], packageId, volumeCount))
+        {
+            removeOutput();
+            return false;
+        }
+    }
+
+    // 替换之前要关闭源封包，输出可能就是源封包
+    reader.Close();
+
+    for (uint32_t volume = 0; volume < volumeCount; volume++)
+    {
+        if (!MoveFileExA(getOutputPath(volume).c_str(), GetVolumePath(pacPath, volume).c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            printf("ERROR: Failed to replace package file.");
+            return false;
+        }
+    }
+
+    // 删除输出路径上次封包多出来的分卷
+    for (size_t volume = volumeCount; volume < oldVolumePaths.size(); volume++)
+    {
+        DeleteFileA(oldVolumePaths[volume].c_str());
+        DeleteFileA(GetIndexCachePath(oldVolumePaths[volume]).c_str());
+        printf("Removed stale volume '%s'.\n", oldVolumePaths[volume].c_str());
+    }
+
+    if (!options.WriteChecksum)
+    {
+        // 上次封包的.sum已经和新的封包对不上了
+        DeleteFileA(GetChecksumPath(pacPath).c_str());
+    }
+    else if (!WriteChecksumFile(pacPath, checksums))
+    {
+        printf("WARNING: Failed to write checksum file.\n");
+    }
+
+    if (options.WriteIndexCache)
+    {
+        for (uint32_t volume = 0; volume < volumeCount; volume++)
+        {
+            auto volumePath = GetVolumePath(pacPath, volume);
+
+            if (!IndexCache::Write(volumePath, compressionMethod, volumeIndexes[volume]))
+            {
+                printf("WARNING: Failed to write index cache '%s'.\n", GetIndexCachePath(volumePath).c_str());
+            }
+        }
+    }
+
+    printf("Stored %u files (%.2f MB) without compression.\n", state.StoredCount.load(), state.StoredBytes / 1048576.0);
+
+    if (sharedCount) printf("Kept %u files sharing data with other entries.\n", sharedCount);
+
+    auto tp2 = steady_clock::now();
+
+    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+
+    printf("[MT] Transcoded %u files, %.2f MB -> %.2f MB, in %llu ms.\n", entryCount, inputBytes / 1048576.0, outputBytes / 1048576.0, ms);
 
     return true;
 }
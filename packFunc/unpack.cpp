@@ -1,14 +1,23 @@
 ﻿#include "packFunc.h"
 
 #include "enc.hpp"
+#include "codec.h"
+#include "asyncReader.h"
+#include "checksum.h"
+#include "indexCache.h"
+#include "hash.hpp"
 #include "huffman/huffmanDecoder.h"
-#include "quote/header/zlib.h"
-#include "quote/header/zstd.h"
 
 // For SHCreateDirectoryExA
 #include <windows.h>
 #include <shlobj.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <future>
 #include <list>
@@ -35,7 +44,8 @@ bool WriteToFile(const std::wstring &path, const void *data, size_t size)
 
     if (fp)
     {
-        if (fwrite(data, size, 1, fp) == 1)
+        // 空文件fwrite返回0
+        if (size == 0 || fwrite(data, size, 1, fp) == 1)
         {
             fclose(fp);
             return true;
@@ -47,206 +57,1350 @@ bool WriteToFile(const std::wstring &path, const void *data, size_t size)
     return false;
 }
 
+/**
+ * @brief 导出结果统计
+ */
+struct ExtractStats
+{
+    size_t ExtractCount = 0;        // 成功处理的文件数
+    size_t SkipCount = 0;           // 输出文件没有改变，跳过写出的文件数，包括在ExtractCount里
+    uint64_t OriginalBytes = 0;     // 解压后的字节数
+    uint64_t CompressedBytes = 0;   // 从封包读取的字节数
+    std::vector<std::string> FailedNames;   // 失败的文件名
+
+    void Merge(const ExtractStats &other)
+    {
+        this->ExtractCount += other.ExtractCount;
+        this->SkipCount += other.SkipCount;
+        this->OriginalBytes += other.OriginalBytes;
+        this->CompressedBytes += other.CompressedBytes;
+        this->FailedNames.insert(this->FailedNames.end(), other.FailedNames.begin(), other.FailedNames.end());
+    }
+};
+
+/**
+ * @brief 和.sum记录的hash比较
+ *
+ * @param hashes 和文件索引一一对应的hash，没有.sum时为nullptr，总是通过
+ * @param index 文件在索引里的位置
+ * @param actual 计算出的hash
+ * @param what 出错时显示的数据种类
+ * @return hash相同或者没有记录时返回true
+ */
+static bool CheckEntryHash(const PackageEntry &entry, const uint64_t *hashes, uint32_t index, uint64_t actual, const char *what)
+{
+    if (!hashes || hashes[index] == actual) return true;
+
+    printf("ERROR: Checksum mismatch of %.64s (%s).\n", entry.Name, what);
+
+    return false;
+}
+
+/**
+ * @brief 分块解压大文件，边解压边写到输出文件
+ *
+ * 需要比较已有的输出文件时，解压出的每一块先和文件的对应部分比较，
+ * 到第一个不同的地方才打开文件写入，内容相同时不写入，保留修改时间
+ *
+ * @param file 封包文件
+ * @param entry 文件索引
+ * @param compressionMethod 压缩方式
+ * @param path 输出文件路径，为空时只解压校验
+ * @param options 导出选项，有.sum的hash时边读取边校验
+ * @param index 文件在索引里的位置
+ * @param[out] unchanged 不为nullptr时比较size相同的已有输出文件，输出内容是否相同
+ * @return 函数执行结果
+ *
+ * 先写到path + ".tmp"，全部解压并且hash校验通过后才替换输出文件，失败时删除临时文件，不会留下不完整的文件
+ */
+static bool ExtractEntryStreamed(HANDLE file, const PackageEntry &entry, uint32_t compressionMethod, const std::wstring &path, const ExtractOptions &options,
+                                 uint32_t index, bool *unchanged = nullptr)
+{
+    FILE *output = nullptr;
+    FILE *existing = nullptr;   // 比较中的已有输出文件
+    auto tempPath = path + L".tmp";
+
+    if (unchanged)
+    {
+        *unchanged = false;
+        existing = _wfopen(path.c_str(), L"rb");
+    }
+
+    if (!path.empty() && !existing && !(output = _wfopen(tempPath.c_str(), L"wb"))) return false;
+
+    std::vector<uint8_t> existingData;
+    uint64_t outputOffset = 0;
+
+    uint64_t offset = entry.Position;
+    uint64_t remaining = entry.CompressedSize;
+
+    XXHash64 compressedHash;
+    XXHash64 originalHash;
+
+    auto reader = [&](uint8_t *buffer, size_t bufferSize, size_t &readSize)
+    {
+        readSize = (size_t)std::min<uint64_t>(bufferSize, remaining);
+
+        if (readSize && !ReadFileAt(file, offset, buffer, (uint32_t)readSize)) return false;
+
+        if (options.CompressedHashes) compressedHash.Update(buffer, readSize);
+
+        offset += readSize;
+        remaining -= readSize;
+
+        return true;
+    };
+
+    auto writer = [&](const uint8_t *data, size_t size)
+    {
+        if (options.Hashes) originalHash.Update(data, size);
+
+        if (existing)
+        {
+            existingData.resize(size);
+
+            if (fread(existingData.data(), size, 1, existing) == 1 && memcmp(existingData.data(), data, size) == 0)
+            {
+                outputOffset += size;
+                return true;
+            }
+
+            // 出现不同的块，把前面相同的部分从已有文件复制到临时文件
+            bool copied = (output = _wfopen(tempPath.c_str(), L"wb")) != nullptr && _fseeki64(existing, 0, SEEK_SET) == 0;
+
+            for (uint64_t copySize = outputOffset; copied && copySize > 0;)
+            {
+                existingData.resize((size_t)std::min<uint64_t>(copySize, 1024 * 1024));
+
+                copied = fread(existingData.data(), existingData.size(), 1, existing) == 1 &&
+                         fwrite(existingData.data(), existingData.size(), 1, output) == 1;
+
+                copySize -= existingData.size();
+            }
+
+            fclose(existing);
+            existing = nullptr;
+
+            if (!copied) return false;
+        }
+
+        outputOffset += size;
+
+        return !output || fwrite(data, size, 1, output) == 1;
+    };
+
+    bool result;
+
+    if (IsStoredEntry(compressionMethod, entry))
+    {
+        std::vector<uint8_t> buffer(1024 * 1024);
+        size_t readSize = 0;
+
+        do
+        {
+            result = reader(buffer.data(), buffer.size(), readSize) && (!readSize || writer(buffer.data(), readSize));
+
+        } while (result && readSize);
+    }
+    else
+    {
+        result = DecompressStream(compressionMethod, entry.OriginalSize, reader, writer);
+    }
+
+    result = result && CheckEntryHash(entry, options.CompressedHashes, index, compressedHash.Digest(), "compressed data") &&
+             CheckEntryHash(entry, options.Hashes, index, originalHash.Digest(), "original data");
+
+    // 一直没有不同的地方，文件没有打开写入
+    if (existing)
+    {
+        fclose(existing);
+
+        if (result) *unchanged = true;
+    }
+
+    if (output)
+    {
+        if (fclose(output) != 0) result = false;
+
+        if (result) result = MoveFileExW(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+
+        if (!result) DeleteFileW(tempPath.c_str());
+    }
+
+    return result;
+}
+
+/**
+ * @brief 获取解压输出的文件路径
+ */
+static std::wstring GetOutputPath(const std::string &dirPath, const std::string &name, int codePage)
+{
+    return AnsiToUnicode(dirPath, CP_ACP) + L"\\" + AnsiToUnicode(name, codePage);
+}
+
+// 已经存在的输出文件和要写出的数据的比较结果
+enum class ExistingFile
+{
+    Changed,        // 不存在或者内容不同，需要写出
+    Unchanged,      // hash和.sum的记录相同，不需要解压
+    SameSize        // size相同，需要解压之后比较内容
+};
+
+/**
+ * @brief 检查已经存在的输出文件是否和封包里的文件相同
+ *
+ * 先比较size，size相同并且有.sum记录的hash时计算输出文件的XXH64比较，不需要读取和解压封包里的数据；
+ * 只有标记和封包一致的.sum才提供hash，否则返回SameSize，解压之后比较内容
+ *
+ * @param path 输出文件路径
+ * @param outputSize 解压后的size
+ * @param hash 标记和封包一致的.sum里记录的原始数据hash，没有时为nullptr
+ * @return 比较结果
+ */
+static ExistingFile CheckExistingFile(const std::wstring &path, uint32_t outputSize, const uint64_t *hash)
+{
+    struct _stat64 fileStat = {};
+
+    if (_wstat64(path.c_str(), &fileStat) != 0 || (fileStat.st_mode & _S_IFDIR) || (uint64_t)fileStat.st_size != outputSize) return ExistingFile::Changed;
+
+    if (!hash) return ExistingFile::SameSize;
+
+    FILE *fp = _wfopen(path.c_str(), L"rb");
+
+    if (!fp) return ExistingFile::Changed;
+
+    std::vector<uint8_t> buffer(1024 * 1024);
+    XXHash64 fileHash;
+    size_t readSize;
+
+    while ((readSize = fread(buffer.data(), 1, buffer.size(), fp)) > 0) fileHash.Update(buffer.data(), readSize);
+
+    fclose(fp);
+
+    return fileHash.Digest() == *hash ? ExistingFile::Unchanged : ExistingFile::Changed;
+}
+
+/**
+ * @brief 逐块比较已经存在的输出文件和解压后的数据，size要先比较过
+ */
+static bool IsSameAsFile(const std::wstring &path, const uint8_t *data, size_t size)
+{
+    FILE *fp = _wfopen(path.c_str(), L"rb");
+
+    if (!fp) return false;
+
+    std::vector<uint8_t> buffer(std::min<size_t>(size, 1024 * 1024));
+    bool same = true;
+
+    for (size_t offset = 0; same && offset < size; offset += buffer.size())
+    {
+        size_t chunk = std::min(buffer.size(), size - offset);
+
+        same = fread(buffer.data(), chunk, 1, fp) == 1 && memcmp(buffer.data(), data + offset, chunk) == 0;
+    }
+
+    fclose(fp);
+
+    return same;
+}
+
+/**
+ * @brief 直接解压到映射的输出文件
+ *
+ * 先把输出文件设置成解压后的size再映射，解压结果直接写进文件的页面，
+ * 不需要解压缓冲区，也省去一次复制。失败时删除输出文件
+ *
+ * @param entry 文件索引，必须是压缩存储的文件
+ * @param compressionMethod 压缩方式
+ * @param data 文件数据，size为entry.CompressedSize
+ * @param path 输出文件路径
+ * @param originalHashes 和文件索引一一对应的原始数据hash，没有时为nullptr
+ * @param index 文件在索引里的位置
+ * @return 函数执行结果
+ */
+static bool ExtractEntryMapped(const PackageEntry &entry, uint32_t compressionMethod, const uint8_t *data, const std::wstring &path, const uint64_t *originalHashes,
+                               uint32_t index)
+{
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    bool result = false;
+
+    FILE_END_OF_FILE_INFO endOfFile;
+    endOfFile.EndOfFile.QuadPart = entry.OriginalSize;
+
+    if (SetFileInformationByHandle(file, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile)))
+    {
+        HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, 0, entry.OriginalSize, NULL);
+
+        if (mapping)
+        {
+            void *view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, entry.OriginalSize);
+
+            if (view)
+            {
+                result = DecompressEntry(compressionMethod, entry, data, static_cast<uint8_t *>(view));
+
+                // 解压的数据还在缓存里，直接在映射上计算hash
+                if (result && originalHashes)
+                {
+                    result = CheckEntryHash(entry, originalHashes, index, XXHash64::Compute(view, entry.OriginalSize), "original data");
+                }
+
+                UnmapViewOfFile(view);
+            }
+
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+
+    if (!result) DeleteFileW(path.c_str());
+
+    return result;
+}
+
+/**
+ * @brief 解压已经读进内存的文件数据并写出
+ *
+ * @param entry 文件索引
+ * @param compressionMethod 压缩方式
+ * @param data 文件数据，size为entry.CompressedSize
+ * @param buffer 解压用的缓冲区，多个文件之间复用，直接存储的文件不使用
+ * @param path 输出文件路径，为空时只解压校验
+ * @param options 导出选项，不小于MapSize的文件直接解压到映射的输出文件，有.sum的hash时校验读取和解压的数据
+ * @param index 文件在索引里的位置
+ * @param[out] unchanged 不为nullptr时解压之后先和size相同的输出文件比较，相同时不写出并设置为true
+ * @return 函数执行结果
+ */
+static bool ExtractEntryData(const PackageEntry &entry, uint32_t compressionMethod, const uint8_t *data, std::vector<uint8_t> &buffer, const std::wstring &path,
+                             const ExtractOptions &options, uint32_t index, bool *unchanged = nullptr)
+{
+    // 损坏的数据不用解压
+    if (options.CompressedHashes && !CheckEntryHash(entry, options.CompressedHashes, index, XXHash64::Compute(data, entry.CompressedSize), "compressed data"))
+    {
+        return false;
+    }
+
+    // 直接存储的文件从读取的数据写出，本来就没有多余的复制
+    if (!path.empty() && !unchanged && !IsStoredEntry(compressionMethod, entry) && entry.OriginalSize > 0 && entry.OriginalSize >= options.MapSize)
+    {
+        return ExtractEntryMapped(entry, compressionMethod, data, path, options.Hashes, index);
+    }
+
+    const uint8_t *output = data;
+
+    if (!IsStoredEntry(compressionMethod, entry))
+    {
+        buffer.resize(entry.OriginalSize);
+
+        if (!DecompressEntry(compressionMethod, entry, data, buffer.data())) return false;
+
+        output = buffer.data();
+    }
+
+    uint32_t outputSize = GetEntryOutputSize(compressionMethod, entry);
+
+    if (options.Hashes && !CheckEntryHash(entry, options.Hashes, index, XXHash64::Compute(output, outputSize), "original data")) return false;
+
+    if (unchanged && (*unchanged = IsSameAsFile(path, output, outputSize))) return true;
+
+    return path.empty() || WriteToFile(path, output, GetEntryOutputSize(compressionMethod, entry));
+}
+
 /**
  * @brief 解压文件到指定目录
  *
- * @param fp 封包文件
- * @param entries 文件索引
- * @param count 文件数量
- * @param compressionMethod 压缩方式
- * @param dirPath 输出目录路径
- * @param closeFile 是否关闭文件stream
- * @return 成功导出的文件数
+ * @param file 封包文件，用FILE_FLAG_OVERLAPPED打开，各线程共用，按位置读取
+ * @param entries 文件索引
+ * @param count 文件数量
+ * @param compressionMethod 压缩方式
+ * @param dirPath 输出目录路径
+ * @param options 导出选项，VerifyOnly时只解压校验不写文件，不小于StreamSize的文件分块解压，不小于MapSize的文件直接解压到映射的输出文件
+ * @return 导出结果统计
+ */
+ExtractStats ExtractEntry(HANDLE file, PackageEntry *entries, uint32_t count, uint32_t compressionMethod, const std::string &dirPath,int codePage ,ExtractOptions options)
+{
+    std::vector<uint8_t> uncompressedData;
+    std::vector<uint8_t> compressedData;
+    ExtractStats stats;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        // printf("Extract %s\n", entries[i].Name);
+
+        std::string name(entries[i].Name, strnlen(entries[i].Name, sizeof(entries[i].Name)));
+
+        uint32_t outputSize = GetEntryOutputSize(compressionMethod, entries[i]);
+
+        // 校验模式下数据直接丢弃
+        std::wstring path = options.VerifyOnly ? std::wstring() : GetOutputPath(dirPath, name, codePage);
+
+        // 没有改变的输出文件不写出，保留修改时间
+        auto existing = ExistingFile::Changed;
+
+        if (options.SkipUnchanged && !path.empty())
+        {
+            existing = CheckExistingFile(path, outputSize, options.Hashes ? &options.Hashes[i] : nullptr);
+
+            if (existing == ExistingFile::Unchanged)
+            {
+                stats.ExtractCount++;
+                stats.SkipCount++;
+                continue;
+            }
+        }
+
+        // 大文件分块解压，不需要整个文件的缓冲区，size相同时边解压边比较
+        if (outputSize >= options.StreamSize)
+        {
+            bool unchanged = false;
+
+            if (!ExtractEntryStreamed(file, entries[i], compressionMethod, path, options, i, existing == ExistingFile::SameSize ? &unchanged : nullptr))
+            {
+                printf("ERROR: Failed to extract %s.\n", name.c_str());
+                stats.FailedNames.emplace_back(std::move(name));
+                continue;
+            }
+
+            stats.CompressedBytes += entries[i].CompressedSize;
+            stats.ExtractCount++;
+            stats.SkipCount += unchanged;
+            stats.OriginalBytes += outputSize;
+            continue;
+        }
+
+        compressedData.resize(entries[i].CompressedSize);
+
+        if (entries[i].CompressedSize && !ReadFileAt(file, entries[i].Position, compressedData.data(), entries[i].CompressedSize))
+        {
+            printf("ERROR: Failed to read %s.\n", name.c_str());
+            stats.FailedNames.emplace_back(std::move(name));
+            continue;
+        }
+
+        stats.CompressedBytes += entries[i].CompressedSize;
+
+        bool unchanged = false;
+
+        if (!ExtractEntryData(entries[i], compressionMethod, compressedData.data(), uncompressedData, path, options, i,
+                              existing == ExistingFile::SameSize ? &unchanged : nullptr))
+        {
+            stats.FailedNames.emplace_back(std::move(name));
+            continue;
+        }
+
+        stats.ExtractCount++;
+        stats.SkipCount += unchanged;
+        stats.OriginalBytes += outputSize;
+    }
+
+    return stats;
+}
+
+// 异步读取时同时提交的读取数，以及读取中和等待解压的数据总size
+static const uint32_t AsyncReadDepth = 32;
+static const uint64_t AsyncReadBudget = 64ULL << 20;
+
+/**
+ * @brief 异步读取的多线程导出
+ *
+ * 当前线程用完成端口批量提交读取，读取完成的数据交给解压线程，读取和解压同时进行。
+ * 读取中和等待解压的数据总共不超过AsyncReadBudget，大文件仍然由解压线程分块读取。
+ * 完成端口中途出错时取消其余的读取，没有完成的文件都改由解压线程同步读取
+ *
+ * @param[out] stats 导出结果统计
+ * @return 不能异步读取或者中途出错时返回false，没有出错的stats包括所有文件
+ */
+static bool ExtractEntryAsync(const std::string &pacPath, PackageEntry *entries, uint32_t count, uint32_t compressionMethod, const std::string &dirPath, int codePage,
+                              const ExtractOptions &options, ExtractStats &stats)
+{
+    AsyncReader reader;
+
+    if (!reader.Open(pacPath)) return false;
+
+    // 分块解压的大文件用另一个没有关联完成端口的句柄读取，各个解压线程的读取可以同时进行
+    HANDLE file = CreateFileA(pacPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    struct ReadJob
+    {
+        uint32_t Index = 0;
+        std::vector<uint8_t> Data;
+        bool Succeeded = true;
+        bool Streamed = false;
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable budgetReleased;
+    std::deque<std::unique_ptr<ReadJob>> jobs;
+    uint64_t heldBytes = 0;     // 读取中和等待解压的数据size
+    bool finished = false;
+    bool readFailed = false;    // 完成端口出错了，之后的文件都同步读取
+
+    auto pushJob = [&](std::unique_ptr<ReadJob> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back(std::move(job));
+        }
+
+        jobReady.notify_one();
+    };
+
+    auto worker = [&](ExtractStats *workerStats)
+    {
+        std::vector<uint8_t> buffer;
+
+        while (true)
+        {
+            std::unique_ptr<ReadJob> job;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                jobReady.wait(lock, [&] { return !jobs.empty() || finished; });
+
+                if (jobs.empty()) break;
+
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            const auto &entry = entries[job->Index];
+            std::string name(entry.Name, strnlen(entry.Name, sizeof(entry.Name)));
+            std::wstring path = options.VerifyOnly ? std::wstring() : GetOutputPath(dirPath, name, codePage);
+            auto existing = ExistingFile::Changed;
+            bool unchanged = false;
+            bool result = false;
+
+            if (options.SkipUnchanged && !path.empty())
+            {
+                existing = CheckExistingFile(path, GetEntryOutputSize(compressionMethod, entry), options.Hashes ? &options.Hashes[job->Index] : nullptr);
+            }
+
+            if (existing == ExistingFile::Unchanged)
+            {
+                unchanged = true;
+                result = true;
+            }
+            else if (job->Streamed)
+            {
+                result = ExtractEntryStreamed(file, entry, compressionMethod, path, options, job->Index,
+                                              existing == ExistingFile::SameSize ? &unchanged : nullptr);
+
+                if (!result) printf("ERROR: Failed to extract %s.\n", name.c_str());
+            }
+            else if (!job->Succeeded)
+            {
+                printf("ERROR: Failed to read %s.\n", name.c_str());
+            }
+            else
+            {
+                workerStats->CompressedBytes += entry.CompressedSize;
+                result = ExtractEntryData(entry, compressionMethod, job->Data.data(), buffer, path, options, job->Index,
+                                          existing == ExistingFile::SameSize ? &unchanged : nullptr);
+            }
+
+            if (result && existing == ExistingFile::Unchanged)
+            {
+                workerStats->ExtractCount++;
+                workerStats->SkipCount++;
+            }
+            else if (result)
+            {
+                if (job->Streamed) workerStats->CompressedBytes += entry.CompressedSize;
+
+                workerStats->ExtractCount++;
+                workerStats->SkipCount += unchanged;
+                workerStats->OriginalBytes += GetEntryOutputSize(compressionMethod, entry);
+            }
+            else
+            {
+                workerStats->FailedNames.emplace_back(std::move(name));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                heldBytes -= job->Data.size();
+            }
+
+            budgetReleased.notify_one();
+        }
+    };
+
+    // 读取由当前线程负责，解压线程比CPU线程数少一个
+    uint32_t workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+    std::vector<ExtractStats> workerStats(workerCount);
+    std::vector<std::thread> workers;
+    workers.reserve(workerCount);
+
+    for (uint32_t i = 0; i < workerCount; i++) workers.emplace_back(worker, &workerStats[i]);
+
+    uint32_t next = 0;
+
+    while (next < count || reader.GetPendingCount() > 0)
+    {
+        // 尽量多提交，直到达到同时读取数或者数据size的上限
+        while (next < count && reader.GetPendingCount() < AsyncReadDepth)
+        {
+            const auto &entry = entries[next];
+
+            std::unique_ptr<ReadJob> job(new ReadJob());
+            job->Index = next;
+
+            if (GetEntryOutputSize(compressionMethod, entry) >= options.StreamSize || (readFailed && entry.CompressedSize > 0))
+            {
+                job->Streamed = true;
+            }
+            else if (entry.CompressedSize > 0)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+
+                if (heldBytes > 0 && heldBytes + entry.CompressedSize > AsyncReadBudget)
+                {
+                    // 还有读取没有取回时先去取回，否则等解压线程释放
+                    if (reader.GetPendingCount() > 0) break;
+
+                    budgetReleased.wait(lock, [&] { return heldBytes == 0 || heldBytes + entry.CompressedSize <= AsyncReadBudget; });
+                }
+
+                heldBytes += entry.CompressedSize;
+                lock.unlock();
+
+                job->Data.resize(entry.CompressedSize);
+
+                if (reader.Submit(entry.Position, job->Data.data(), entry.CompressedSize, (uintptr_t)job.get()))
+                {
+                    job.release();
+                    next++;
+                    continue;
+                }
+
+                job->Succeeded = false;
+            }
+
+            pushJob(std::move(job));
+            next++;
+        }
+
+        if (reader.GetPendingCount() == 0) continue;
+
+        uintptr_t tag;
+        bool succeeded;
+
+        if (!reader.Wait(tag, succeeded))
+        {
+            printf("WARNING: Asynchronous reads failed, reading the remaining files synchronously.\n");
+
+            readFailed = true;
+
+            // 取消之后缓冲区不会再被写入，这些文件交给解压线程重新同步读取
+            for (uintptr_t pendingTag : reader.Cancel())
+            {
+                std::unique_ptr<ReadJob> pending(reinterpret_cast<ReadJob *>(pendingTag));
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    heldBytes -= pending->Data.size();
+                }
+
+                std::vector<uint8_t>().swap(pending->Data);
+                pending->Streamed = true;
+
+                pushJob(std::move(pending));
+            }
+
+            continue;
+        }
+
+        std::unique_ptr<ReadJob> job(reinterpret_cast<ReadJob *>(tag));
+        job->Succeeded = succeeded;
+
+        pushJob(std::move(job));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+
+    jobReady.notify_all();
+
+    for (auto &thread : workers) thread.join();
+
+    for (const auto &workerStat : workerStats) stats.Merge(workerStat);
+
+    CloseHandle(file);
+
+    return !readFailed;
+}
+
+/**
+ * @brief 多线程导出文件
+ *
+ * @param pacPath 目标封包
+ * @param entries 封包内文件信息list
+ * @param count 封包文件计数
+ * @param compressionMethod 封包压缩方式
+ * @param dirPath 导出的目标文件夹
+ * @param options 导出选项
+ * @return 导出结果统计
+ */
+ExtractStats ExtractEntryMT(const std::string &pacPath, PackageEntry *entries, uint32_t count, uint32_t compressionMethod, const std::string &dirPath,int codePage, const ExtractOptions &options)
+{
+    ExtractStats stats;
+
+    if (options.Io == IoMode::Async)
+    {
+        if (ExtractEntryAsync(pacPath, entries, count, compressionMethod, dirPath, codePage, options, stats)) return stats;
+
+        // 中途出错时剩下的文件已经同步读取过了
+        if (stats.ExtractCount + stats.FailedNames.size() == count) return stats;
+
+        printf("WARNING: Asynchronous I/O is not available, using synchronous reads.\n");
+    }
+
+    // 所有线程共用一个文件句柄，按位置读取，用FILE_FLAG_OVERLAPPED打开，各个线程的读取不会排成一队；
+    // 每个线程处理连续的一段文件，所以按顺序读取提示预读
+    HANDLE file = CreateFileA(pacPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        printf("ERROR: Failed to open package file '%s'.\n", pacPath.c_str());
+        return stats;
+    }
+
+    auto maxThreads = std::thread::hardware_concurrency();
+    auto filesPerThread = (uint32_t)ceilf((float)count / (float)maxThreads); // 单线程处理的文件数，向上取整
+
+    uint32_t remaining = count; // 未处理的文件数
+    uint32_t j = 0;
+
+    std::list<std::future<ExtractStats>> tasks;
+
+    for (uint32_t i = 0; i < maxThreads && remaining > 0; i++)
+    {
+        uint32_t processCount = std::min(remaining, filesPerThread); // 当前线程要处理的文件数
+        remaining -= processCount;
+
+        // printf("Start worker thread to processing [%d,%d]\n", j, j + processCount - 1); // 打印当前线程处理的文件的index
+
+        auto startEntry = entries + j;
+
+        ExtractOptions taskOptions = options;
+
+        if (options.Hashes) taskOptions.Hashes = options.Hashes + j;
+        if (options.CompressedHashes) taskOptions.CompressedHashes = options.CompressedHashes + j;
+
+        auto task = std::async(std::launch::async, ExtractEntry, file, startEntry, processCount, compressionMethod, dirPath, codePage, taskOptions);
+        tasks.emplace_back(std::move(task));
+
+        j += processCount;
+    }
+
+    for (auto &t : tasks) stats.Merge(t.get());
+
+    CloseHandle(file);
+
+    return stats;
+}
+
+/**
+ * @brief 读取并解码封包索引
+ *
+ * 只读取文件头和尾部的索引块，不访问文件数据
+ *
+ * @param fp 封包文件
+ * @param compressionMethod 输出封包压缩方式
+ * @param entries 输出文件索引
+ * @return 函数执行结果
+ */
+bool ReadPackageIndex(FILE *fp, uint32_t &compressionMethod, std::vector<PackageEntry> &entries)
+{
+    uint8_t magic[4];
+
+    if (fread(magic, 4, 1, fp) != 1 || magic[0] != 0x50 || magic[1] != 0x41 || magic[2] != 0x43)
+    {
+        printf("ERROR: Invalid package file.");
+        return false;
+    }
+
+    uint32_t entryCount;
+    uint32_t compressedIndexSize;
+
+    if (fread(&entryCount, 4, 1, fp) != 1 || fread(&compressionMethod, 4, 1, fp) != 1)
+    {
+        printf("ERROR: Invalid package file.");
+        return false;
+    }
+
+    _fseeki64(fp, 0, SEEK_END);
+    int64_t fileSize = _ftelli64(fp);
+
+    // 文件头12字节 + 索引 + 索引size4字节
+    if (fileSize < 16 || _fseeki64(fp, -4, SEEK_END) != 0 || fread(&compressedIndexSize, 4, 1, fp) != 1 ||
+        compressedIndexSize > fileSize - 16)
+    {
+        printf("ERROR: Invalid package index.");
+        return false;
+    }
+
+    // 每个字节至少要1bit的Huffman编码，文件数量和压缩后的索引对不上的是损坏的文件头
+    uint64_t indexSize = (uint64_t)sizeof(PackageEntry) * entryCount;
+
+    if (indexSize > UINT32_MAX || indexSize > (uint64_t)compressedIndexSize * 8)
+    {
+        printf("ERROR: Invalid package index.");
+        return false;
+    }
+
+    std::vector<uint8_t> compressedIndex;
+    compressedIndex.resize(compressedIndexSize);
+
+    _fseeki64(fp, fileSize - 4 - compressedIndexSize, SEEK_SET);
+
+    if (compressedIndexSize && fread(compressedIndex.data(), compressedIndexSize, 1, fp) != 1)
+    {
+        printf("ERROR: Failed to read package index.");
+        return false;
+    }
+
+    // Decrypt index
+    for (uint32_t i = 0; i < compressedIndexSize; i++)
+    {
+        compressedIndex[i] = ~compressedIndex[i];
+    }
+
+    entries.resize(entryCount);
+
+    // Decompress index
+    HuffmanDecoder huffmanDecoder(compressedIndex.data(), compressedIndexSize);
+    huffmanDecoder.Decode(reinterpret_cast<uint8_t *>(entries.data()), (uint32_t)indexSize);
+
+    return true;
+}
+
+/**
+ * @brief 读取一个分卷的索引，有和封包对得上的.idx时直接复制，不解码
+ *
+ * @param path 封包文件路径，分卷时为这个分卷
+ * @param compressionMethod 输出封包压缩方式
+ * @param entries 输出文件索引
+ * @return 函数执行结果
+ */
+bool LoadPackageIndex(const std::string &path, uint32_t &compressionMethod, std::vector<PackageEntry> &entries)
+{
+    IndexCache indexCache;
+
+    if (indexCache.Open(path))
+    {
+        compressionMethod = indexCache.GetCompressionMethod();
+        entries.assign(indexCache.GetEntries(), indexCache.GetEntries() + indexCache.GetEntryCount());
+        return true;
+    }
+
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp)
+    {
+        printf("ERROR: Failed to open package file.");
+        return false;
+    }
+
+    bool result = ReadPackageIndex(fp, compressionMethod, entries);
+
+    fclose(fp);
+
+    return result;
+}
+
+/**
+ * @brief 读取封包所有分卷的索引
+ *
+ * @param pacPath 封包文件路径，分卷时为第一卷
+ * @param compressionMethod 输出封包压缩方式
+ * @param volumePaths 输出每个分卷的路径
+ * @param volumeEntries 输出每个分卷的文件索引
+ * @return 函数执行结果，分卷的压缩方式不同也返回false
  */
-size_t ExtractEntry(FILE *fp, PackageEntry *entries, uint32_t count, uint32_t compressionMethod, const std::string &dirPath,int codePage ,bool closeFile)
+static bool ReadVolumeIndexes(const std::string &pacPath, uint32_t &compressionMethod, std::vector<std::string> &volumePaths,
+                              std::vector<std::vector<PackageEntry>> &volumeEntries)
 {
-    std::vector<uint8_t> uncompressedData;
-    std::vector<uint8_t> compressedData;
-    size_t extractCount = 0;
+    volumePaths = FindVolumePaths(pacPath);
+    volumeEntries.resize(volumePaths.size());
 
-    for (uint32_t i = 0; i < count; i++)
+    for (size_t volume = 0; volume < volumePaths.size(); volume++)
     {
-        // printf("Extract %s\n", entries[i].Name);
+        uint32_t volumeMethod;
 
-        fseek(fp, entries[i].Position, SEEK_SET);
+        if (!LoadPackageIndex(volumePaths[volume], volumeMethod, volumeEntries[volume])) return false;
 
-        if (compressionMethod != 0) // 判断文件是否被压缩
+        if (volume == 0)
+        {
+            compressionMethod = volumeMethod;
+        }
+        else if (volumeMethod != compressionMethod)
         {
-            uncompressedData.resize(entries[i].OriginalSize);
-            compressedData.resize(entries[i].CompressedSize);
+            printf("ERROR: Volume '%s' uses a different compression method.\n", volumePaths[volume].c_str());
+            return false;
+        }
+    }
 
-            if (entries[i].OriginalSize != entries[i].CompressedSize)
-            {
-                fread(compressedData.data(), entries[i].CompressedSize, 1, fp);
+    if (volumePaths.size() > 1) printf("Package has %u volumes.\n", (uint32_t)volumePaths.size());
 
-                if (compressionMethod == 4)
-                {
-                    uLong sourceLen = entries[i].CompressedSize;
-                    uLongf destLen = entries[i].OriginalSize;
+    return true;
+}
 
-                    int result = uncompress((Bytef *)uncompressedData.data(), &destLen, (Bytef *)compressedData.data(), sourceLen);
+/**
+ * @brief 读取封包旁边的.sum，hash和所有分卷连续编号的索引一一对应
+ *
+ * .sum写入之后封包改变过，或者和封包的索引对不上时当作没有
+ *
+ * @param[out] originalHashes 原始数据的hash，没有.sum时为空
+ * @param[out] compressedHashes 封包里数据的hash，没有.sum时为空
+ * @return 是否读取了.sum
+ */
+static bool ReadPackageHashes(const std::string &pacPath, const std::vector<std::vector<PackageEntry>> &volumeEntries, std::vector<uint64_t> &originalHashes,
+                              std::vector<uint64_t> &compressedHashes)
+{
+    std::vector<ChecksumEntry> checksums;
 
-                    if (result != Z_OK)
-                    {
-                        printf("ERROR: Failed to uncompress %s with zlib.\n", entries[i].Name);
-                        continue;
-                    }
-                }
-                else if (compressionMethod == 7)
-                {
-                    size_t result = ZSTD_decompress(uncompressedData.data(), entries[i].OriginalSize, compressedData.data(), entries[i].CompressedSize);
+    originalHashes.clear();
+    compressedHashes.clear();
 
-                    if (ZSTD_isError(result))
-                    {
-                        printf("ERROR: Failed to uncompress %s with zstd(%s).\n", entries[i].Name, ZSTD_getErrorName(result));
-                        continue;
-                    }
-                }
-            }
-            else
-            {
-                fread(uncompressedData.data(), entries[i].CompressedSize, 1, fp);
-            }
-        }
-        else
+    if (!ReadPackageChecksums(pacPath, checksums)) return false;
+
+    uint32_t i = 0;
+    bool matched = true;
+
+    for (const auto &entries : volumeEntries)
+    {
+        for (const auto &entry : entries)
         {
-            uncompressedData.resize(entries[i].CompressedSize);
-            fread(uncompressedData.data(), entries[i].CompressedSize, 1, fp);
+            matched = matched && i < checksums.size() && memcmp(checksums[i].Name, entry.Name, sizeof(entry.Name)) == 0 &&
+                      checksums[i].CompressedSize == entry.CompressedSize;
+            i++;
         }
+    }
 
-        std::wstring path = AnsiToUnicode(dirPath, CP_ACP) + L"\\" + AnsiToUnicode(entries[i].Name, codePage);
+    if (!matched || i != checksums.size())
+    {
+        printf("WARNING: Checksum file does not match the package, ignored.\n");
+        return false;
+    }
 
-        if (WriteToFile(path, uncompressedData.data(), uncompressedData.size()))    extractCount++;
+    for (const auto &checksum : checksums)
+    {
+        originalHashes.emplace_back(checksum.OriginalHash);
+        compressedHashes.emplace_back(checksum.CompressedHash);
     }
 
-    if (closeFile)
+    return true;
+}
+
+/**
+ * @brief 依次导出所有分卷，每个分卷使用.sum里对应的那一段hash
+ */
+static ExtractStats ExtractVolumes(const std::vector<std::string> &volumePaths, std::vector<std::vector<PackageEntry>> &volumeEntries, uint32_t compressionMethod,
+                                   const std::string &dirPath, int codePage, ExtractOptions options, const std::vector<uint64_t> &originalHashes,
+                                   const std::vector<uint64_t> &compressedHashes)
+{
+    ExtractStats stats;
+    uint32_t firstEntry = 0;
+
+    for (size_t volume = 0; volume < volumePaths.size(); volume++)
     {
-        fclose(fp);
+        auto &entries = volumeEntries[volume];
+
+        options.Hashes = originalHashes.empty() ? nullptr : originalHashes.data() + firstEntry;
+        options.CompressedHashes = compressedHashes.empty() ? nullptr : compressedHashes.data() + firstEntry;
+        firstEntry += entries.size();
+
+        stats.Merge(ExtractEntryMT(volumePaths[volume], entries.data(), entries.size(), compressionMethod, dirPath, codePage, options));
     }
 
-    return extractCount;
+    return stats;
 }
 
 /**
- * @brief 多线程导出文件
+ * @brief 解包
  *
- * @param pacPath 目标封包
- * @param entries 封包内文件信息list
- * @param count 封包文件计数
- * @param compressionMethod 封包压缩方式
- * @param dirPath 导出的目标文件夹
- * @return 成功导出的文件数
+ * @param pacPath 封包文件路径
+ * @param dirPath 输出目录路径
+ * @param options 导出选项
+ * @return 函数执行结果
  */
-size_t ExtractEntryMT(const std::string &pacPath, PackageEntry *entries, uint32_t count, uint32_t compressionMethod, const std::string &dirPath,int codePage)
+bool ExtractPackage(const std::string &pacPath, const std::string &dirPath,int codePage, const ExtractOptions &options)
 {
-    auto maxThreads = std::thread::hardware_concurrency();
-    auto filesPerThread = (uint32_t)ceilf((float)count / (float)maxThreads); // 单线程处理的文件数，向上取整
+    uint32_t compressionMethod;
+    std::vector<std::string> volumePaths;
+    std::vector<std::vector<PackageEntry>> volumeEntries;
 
-    size_t extractCount = 0;    // 导出的文件数
-    uint32_t remaining = count; // 未处理的文件数
-    uint32_t j = 0;
+    if (!ReadVolumeIndexes(pacPath, compressionMethod, volumePaths, volumeEntries)) return false;
 
-    std::list<std::future<size_t>> tasks;
+    uint32_t entryCount = 0;
 
-    for (uint32_t i = 0; i < maxThreads; i++)
-    {
-        uint32_t processCount = std::min(remaining, filesPerThread); // 当前线程要处理的文件数
-        remaining -= processCount;
+    for (const auto &entries : volumeEntries) entryCount += entries.size();
 
-        // printf("Start worker thread to processing [%d,%d]\n", j, j + processCount - 1); // 打印当前线程处理的文件的index
+    printf("Total %d files in the package.\n", entryCount);
+
+    // 偷懒方式创建文件夹
+    SHCreateDirectoryExA(NULL, dirPath.c_str(), NULL);
 
-        auto fp = fopen(pacPath.c_str(), "rb");
+    // 有和封包一致的.sum时解压的同时校验hash，跳过未改变的文件时用记录的hash比较，不需要解压；
+    // 过期的.sum在ReadPackageHashes里被忽略，这时解压之后比较内容
+    std::vector<uint64_t> originalHashes;
+    std::vector<uint64_t> compressedHashes;
 
-        if (fp)
-        {
-            auto startEntry = entries + j;
-            auto task = std::async(std::launch::async, ExtractEntry, fp, startEntry, processCount, compressionMethod, dirPath, codePage ,true);
-            tasks.emplace_back(std::move(task));
-        }
+    if (ReadPackageHashes(pacPath, volumeEntries, originalHashes, compressedHashes)) printf("Checking entries against the checksum file.\n");
 
-        j += processCount;
+    if (options.SkipUnchanged) printf("Skipping unchanged files%s.\n", originalHashes.empty() ? " (no up-to-date checksum file, comparing contents)" : "");
+
+    auto tp1 = steady_clock::now();
+
+    // ExtractEntry(fp, entries.data(), entryCount, compressionMethod, dirPath, false);
+    ExtractStats stats = ExtractVolumes(volumePaths, volumeEntries, compressionMethod, dirPath, codePage, options, originalHashes, compressedHashes);
+
+    auto tp2 = steady_clock::now();
+
+    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+
+    printf("Extracted %d files in %llu ms.\n", stats.ExtractCount, ms);
+
+    if (options.SkipUnchanged) printf("%u files were unchanged and not written.\n", (uint32_t)stats.SkipCount);
+
+    // 封包打不开或者线程没有启动成功时也算失败
+    if (stats.ExtractCount + stats.FailedNames.size() != entryCount)
+    {
+        printf("ERROR: %u files were not extracted.\n", entryCount - (uint32_t)(stats.ExtractCount + stats.FailedNames.size()));
+        return false;
     }
 
-    for (auto &t : tasks) extractCount += t.get();
+    if (!stats.FailedNames.empty())
+    {
+        printf("%u files failed:\n", (uint32_t)stats.FailedNames.size());
+
+        for (const auto &name : stats.FailedNames) printf("  %s\n", name.c_str());
+
+        return false;
+    }
 
-    return extractCount;
+    return true;
 }
 
 /**
- * @brief 解包
+ * @brief 校验封包
+ *
+ * 和解包走同一套解压流程，但不写出文件，检查数据能否正确解压，有.sum时还比较读取和解压的数据的hash
  *
  * @param pacPath 封包文件路径
- * @param dirPath 输出目录路径
- * @return 函数执行结果
+ * @param requestedOptions 校验选项，VerifyOnly总是为true
+ * @return 所有文件都校验通过返回true
  */
-bool ExtractPackage(const std::string &pacPath, const std::string &dirPath,int codePage)
+bool VerifyPackage(const std::string &pacPath, const ExtractOptions &requestedOptions)
 {
-    FILE *fp = fopen(pacPath.c_str(), "rb");
+    uint32_t compressionMethod;
+    std::vector<std::string> volumePaths;
+    std::vector<std::vector<PackageEntry>> volumeEntries;
 
-    if (!fp)
+    if (!ReadVolumeIndexes(pacPath, compressionMethod, volumePaths, volumeEntries)) return false;
+
+    uint32_t entryCount = 0;
+
+    for (const auto &entries : volumeEntries) entryCount += entries.size();
+
+    printf("Total %d files in the package.\n", entryCount);
+
+    ExtractOptions options = requestedOptions;
+    options.VerifyOnly = true;
+
+    // 有.sum时还要和记录的hash比较，可以发现解压不出错的损坏
+    std::vector<uint64_t> originalHashes;
+    std::vector<uint64_t> compressedHashes;
+
+    if (ReadPackageHashes(pacPath, volumeEntries, originalHashes, compressedHashes)) printf("Checking entries against the checksum file.\n");
+
+    auto tp1 = steady_clock::now();
+
+    ExtractStats stats = ExtractVolumes(volumePaths, volumeEntries, compressionMethod, std::string(), CP_ACP, options, originalHashes, compressedHashes);
+
+    auto tp2 = steady_clock::now();
+
+    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+
+    double seconds = std::max<double>(ms, 1) / 1000.0;
+
+    printf("Verified %d files in %llu ms, %.2f MB at %.2f MB/s (read %.2f MB/s).\n", stats.ExtractCount, ms,
+           stats.OriginalBytes / 1048576.0, stats.OriginalBytes / 1048576.0 / seconds, stats.CompressedBytes / 1048576.0 / seconds);
+
+    // 线程没有启动成功时也算失败
+    if (stats.ExtractCount + stats.FailedNames.size() != entryCount)
     {
-        printf("ERROR: Failed to open package file.");
+        printf("ERROR: %u files were not checked.\n", entryCount - (uint32_t)(stats.ExtractCount + stats.FailedNames.size()));
         return false;
     }
 
-    uint8_t magic[4];
-    fread(magic, 4, 1, fp);
-
-    if (magic[0] != 0x50 || magic[1] != 0x41 || magic[2] != 0x43)
+    if (!stats.FailedNames.empty())
     {
-        fclose(fp);
-        printf("ERROR: Invalid package file.");
+        printf("%u files failed:\n", (uint32_t)stats.FailedNames.size());
+
+        for (const auto &name : stats.FailedNames) printf("  %s\n", name.c_str());
+
         return false;
     }
 
-    uint32_t entryCount;
+    printf("All files OK.\n");
+
+    return true;
+}
+
+/**
+ * @brief 尽量让系统丢弃文件的缓存
+ *
+ * 没有其他句柄映射这个文件时，用FILE_FLAG_NO_BUFFERING打开会让系统写回并丢弃它的缓存，
+ * 系统不保证一定丢弃，需要严格的冷缓存时应在测试之前清空待机内存
+ */
+static void PurgeFileCache(const std::string &path)
+{
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+}
+
+/**
+ * @brief 比较同步读取和异步读取的校验速度
+ *
+ * 每次校验之前丢弃分卷的缓存，测量冷缓存下从磁盘读取并解压所有文件的时间
+ *
+ * @param pacPath 封包文件路径
+ * @param runs 每种读取方式的测试次数
+ * @return 函数执行结果
+ */
+bool BenchmarkPackage(const std::string &pacPath, uint32_t runs)
+{
     uint32_t compressionMethod;
-    uint32_t compressedIndexSize;
+    std::vector<std::string> volumePaths;
+    std::vector<std::vector<PackageEntry>> volumeEntries;
 
-    fread(&entryCount, 4, 1, fp);
-    fread(&compressionMethod, 4, 1, fp);
+    if (!ReadVolumeIndexes(pacPath, compressionMethod, volumePaths, volumeEntries)) return false;
+
+    uint32_t entryCount = 0;
+
+    for (const auto &entries : volumeEntries) entryCount += entries.size();
 
     printf("Total %d files in the package.\n", entryCount);
 
-    fseek(fp, -4, SEEK_END);
-    fread(&compressedIndexSize, 4, 1, fp);
+    std::vector<uint64_t> originalHashes;
+    std::vector<uint64_t> compressedHashes;
 
-    std::vector<uint8_t> compressedIndex;
-    compressedIndex.resize(compressedIndexSize);
+    ReadPackageHashes(pacPath, volumeEntries, originalHashes, compressedHashes);
 
-    fseek(fp, -(compressedIndexSize + 4), SEEK_END);
-    fread(compressedIndex.data(), compressedIndexSize, 1, fp);
+    const IoMode modes[] = {IoMode::Sync, IoMode::Async};
+    uint64_t bestMs[2] = {UINT64_MAX, UINT64_MAX};
+    uint64_t originalBytes = 0;
+    bool succeeded = true;
 
-    // Decrypt index
-    for (uint32_t i = 0; i < compressedIndexSize; i++)
+    for (uint32_t run = 0; run < std::max(runs, 1u); run++)
     {
-        compressedIndex[i] = ~compressedIndex[i];
+        for (int mode = 0; mode < 2; mode++)
+        {
+            ExtractOptions options;
+            options.VerifyOnly = true;
+            options.Io = modes[mode];
+
+            for (const auto &path : volumePaths) PurgeFileCache(path);
+
+            auto tp1 = steady_clock::now();
+
+            ExtractStats stats = ExtractVolumes(volumePaths, volumeEntries, compressionMethod, std::string(), CP_ACP, options, originalHashes, compressedHashes);
+
+            auto tp2 = steady_clock::now();
+
+            uint64_t ms = duration_cast<milliseconds>(tp2 - tp1).count();
+            double seconds = std::max<double>(ms, 1) / 1000.0;
+
+            printf("Run %u %-5s: %llu ms, %.2f MB/s (read %.2f MB/s)\n", run + 1, mode == 0 ? "sync" : "async", ms,
+                   stats.OriginalBytes / 1048576.0 / seconds, stats.CompressedBytes / 1048576.0 / seconds);
+
+            if (stats.ExtractCount != entryCount)
+            {
+                printf("ERROR: %u files failed to verify.\n", entryCount - (uint32_t)stats.ExtractCount);
+                succeeded = false;
+            }
+
+            bestMs[mode] = std::min(bestMs[mode], ms);
+            originalBytes = stats.OriginalBytes;
+        }
     }
 
-    uint32_t indexSize = sizeof(PackageEntry) * entryCount;
+    printf("Best sync %llu ms, async %llu ms for %.2f MB.\n", bestMs[0], bestMs[1], originalBytes / 1048576.0);
 
-    std::vector<uint8_t> index;
-    index.resize(indexSize);
+    return succeeded;
+}
 
-    // Decompress index
-    HuffmanDecoder huffmanDecoder(compressedIndex.data(),compressedIndexSize);
-    huffmanDecoder.Decode(index.data(),indexSize);
+/**
+ * @brief 获取压缩方式名称
+ *
+ * @param compressionMethod 压缩方式
+ * @return 名称
+ */
+const char *GetCompressionName(uint32_t compressionMethod)
+{
+    if (compressionMethod == 4)
+        return "zlib";
+    else if (compressionMethod == 7)
+        return "zstd";
+    return "no";
+}
 
-    // 偷懒方式创建文件夹
-    SHCreateDirectoryExA(NULL, dirPath.c_str(), NULL);
+/**
+ * @brief 按CSV/JSON的规则转义文件名
+ *
+ * @param name 文件名(UTF-8)
+ * @param format 输出格式
+ * @return 转义后的字符串
+ */
+static std::string EscapeName(const std::string &name, ListFormat format)
+{
+    std::string output;
+    output.reserve(name.size() + 2);
+    output.push_back('"');
+
+    for (char c : name)
+    {
+        if (c == '"')
+        {
+            output.append(format == ListFormat::Csv ? "\"\"" : "\\\"");
+        }
+        else if (format == ListFormat::Json && c == '\\')
+        {
+            output.append("\\\\");
+        }
+        else if (format == ListFormat::Json && (uint8_t)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)c);
+            output.append(escaped);
+        }
+        else
+        {
+            output.push_back(c);
+        }
+    }
+
+    output.push_back('"');
+    return output;
+}
 
+/**
+ * @brief 列出封包内的文件
+ *
+ * 只读取和解码索引，不访问文件数据
+ *
+ * @param pacPath 封包文件路径
+ * @param format 输出格式
+ * @param codePage 文件名的代码页
+ * @return 函数执行结果
+ */
+bool ListPackage(const std::string &pacPath, ListFormat format, int codePage)
+{
     auto tp1 = steady_clock::now();
 
-    // ExtractEntry(fp, (PackageEntry*)index.data(), entryCount, compressionMethod, dirPath, false);
-    size_t extractCount = ExtractEntryMT(pacPath, (PackageEntry *)index.data(), entryCount, compressionMethod, dirPath,codePage);
+    uint32_t compressionMethod;
+    std::vector<std::string> volumePaths;
+    std::vector<std::vector<PackageEntry>> volumeEntries;
 
-    auto tp2 = steady_clock::now();
+    if (!ReadVolumeIndexes(pacPath, compressionMethod, volumePaths, volumeEntries)) return false;
 
-    auto ms = duration_cast<milliseconds>(tp2 - tp1).count();
+    // 所有分卷的文件按分卷顺序连续编号，Position是分卷内的位置
+    std::vector<PackageEntry> entries;
+    std::vector<uint32_t> entryVolumes;
 
-    printf("Extracted %d files in %llu ms.\n", extractCount, ms);
+    for (uint32_t volume = 0; volume < volumeEntries.size(); volume++)
+    {
+        entries.insert(entries.end(), volumeEntries[volume].begin(), volumeEntries[volume].end());
+        entryVolumes.insert(entryVolumes.end(), volumeEntries[volume].size(), volume);
+    }
 
-    fclose(fp);
+    uint64_t totalOriginalSize = 0;
+    uint64_t totalCompressedSize = 0;
+
+    for (const auto &entry : entries)
+    {
+        totalOriginalSize += entry.OriginalSize;
+        totalCompressedSize += entry.CompressedSize;
+    }
+
+    auto GetRatio = [](uint64_t compressedSize, uint64_t originalSize) -> double
+    {
+        return originalSize ? (double)compressedSize * 100.0 / (double)originalSize : 100.0;
+    };
+
+    if (format == ListFormat::Text)
+    {
+        printf("%8s %10s %10s %10s %7s  %s\n", "Index", "Position", "Original", "Compressed", "Ratio", "Name");
+
+        for (uint32_t i = 0; i < entries.size(); i++)
+        {
+            const auto &entry = entries[i];
+
+            if (volumePaths.size() > 1 && (i == 0 || entryVolumes[i] != entryVolumes[i - 1]))
+            {
+                printf("Volume %u: %s\n", entryVolumes[i], volumePaths[entryVolumes[i]].c_str());
+            }
+
+            printf("%8u %10u %10u %10u %6.2f%%  %.*s\n", i, entry.Position, entry.OriginalSize, entry.CompressedSize,
+                   GetRatio(entry.CompressedSize, entry.OriginalSize), (int)sizeof(entry.Name), entry.Name);
+        }
+
+        auto ms = duration_cast<milliseconds>(steady_clock::now() - tp1).count();
+
+        printf("Total %u files, compression %s, original %llu bytes, compressed %llu bytes, ratio %.2f%%, listed in %llu ms.\n",
+               (uint32_t)entries.size(), GetCompressionName(compressionMethod), totalOriginalSize, totalCompressedSize,
+               GetRatio(totalCompressedSize, totalOriginalSize), ms);
+    }
+    else
+    {
+        if (format == ListFormat::Csv)
+        {
+            printf("index,name,position,original_size,compressed_size,ratio,volume\n");
+        }
+        else
+        {
+            printf("{\n  \"compression\": \"%s\",\n  \"count\": %u,\n  \"original_size\": %llu,\n  \"compressed_size\": %llu,\n  \"ratio\": %.2f,\n  \"volumes\": %u,\n  \"entries\": [",
+                   GetCompressionName(compressionMethod), (uint32_t)entries.size(), totalOriginalSize, totalCompressedSize,
+                   GetRatio(totalCompressedSize, totalOriginalSize), (uint32_t)volumePaths.size());
+        }
+
+        for (uint32_t i = 0; i < entries.size(); i++)
+        {
+            const auto &entry = entries[i];
+
+            // 索引里的文件名不一定以0结尾
+            std::string name(entry.Name, strnlen(entry.Name, sizeof(entry.Name)));
+            name = EscapeName(UnicodeToAnsi(AnsiToUnicode(name, codePage), CP_UTF8), format);
+
+            if (format == ListFormat::Csv)
+            {
+                printf("%u,%s,%u,%u,%u,%.2f,%u\n", i, name.c_str(), entry.Position, entry.OriginalSize, entry.CompressedSize,
+                       GetRatio(entry.CompressedSize, entry.OriginalSize), entryVolumes[i]);
+            }
+            else
+            {
+                printf("%s\n    {\"index\": %u, \"name\": %s, \"position\": %u, \"original_size\": %u, \"compressed_size\": %u, \"ratio\": %.2f, \"volume\": %u}",
+                       i ? "," : "", i, name.c_str(), entry.Position, entry.OriginalSize, entry.CompressedSize,
+                       GetRatio(entry.CompressedSize, entry.OriginalSize), entryVolumes[i]);
+            }
+        }
+
+        if (format == ListFormat::Json) printf("\n  ]\n}\n");
+    }
 
     return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,105 @@
+#include "packFunc.h"
+
+#include <windows.h>
+#include <cstring>
+
+static const uint8_t VolumeTagMagic[] = {0x50, 0x56, 0x4F, 0x4C}; // PVOL
+
+/**
+ * @brief 获取分卷的路径
+ *
+ * 第0卷就是封包本身，之后的分卷在扩展名前加上卷号，例如data.pac、data.1.pac、data.2.pac
+ *
+ * @param pacPath 封包路径
+ * @param volume 卷号
+ * @return 分卷路径
+ */
+std::string GetVolumePath(const std::string &pacPath, uint32_t volume)
+{
+    if (volume == 0) return pacPath;
+
+    auto separator = pacPath.find_last_of("\\/");
+    auto dot = pacPath.find_last_of('.');
+
+    // 文件名没有扩展名时直接加在末尾
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) dot = pacPath.size();
+
+    return pacPath.substr(0, dot) + "." + std::to_string(volume) + pacPath.substr(dot);
+}
+
+/**
+ * @brief 创建分卷标记，分卷数量在写入索引时更新
+ *
+ * @param packageId 封包的标识，由所有分卷的索引生成，写入时还不知道的先写0
+ * @param volume 卷号
+ * @return 分卷标记
+ */
+VolumeTag MakeVolumeTag(uint32_t packageId, uint32_t volume)
+{
+    VolumeTag tag;
+    memcpy(tag.Magic, VolumeTagMagic, 4);
+    tag.PackageId = packageId;
+    tag.Volume = volume;
+    tag.VolumeCount = 0;
+
+    return tag;
+}
+
+/**
+ * @brief 读取文件头后面的分卷标记
+ *
+ * @param path 分卷路径
+ * @param tag 输出分卷标记
+ * @return 不是封包或者没有分卷标记时返回false
+ */
+bool ReadVolumeTag(const std::string &path, VolumeTag &tag)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+
+    if (!fp) return false;
+
+    // 文件头: magic(4) + 文件数量(4) + 压缩方式(4)
+    uint8_t header[12];
+
+    bool result = fread(header, sizeof(header), 1, fp) == 1 && fread(&tag, sizeof(tag), 1, fp) == 1;
+
+    fclose(fp);
+
+    return result && header[0] == 0x50 && header[1] == 0x41 && header[2] == 0x43 && memcmp(tag.Magic, VolumeTagMagic, 4) == 0;
+}
+
+/**
+ * @brief 查找封包的所有分卷
+ *
+ * 分卷数量和封包标识记录在第0卷的分卷标记里，其余分卷的标记必须和它对得上，
+ * 没有分卷标记的封包只有一卷，旁边同名的data.1.pac属于别的封包
+ *
+ * @param pacPath 封包路径
+ * @return 所有分卷的路径，第一个总是封包本身
+ */
+std::vector<std::string> FindVolumePaths(const std::string &pacPath)
+{
+    std::vector<std::string> paths;
+    paths.emplace_back(pacPath);
+
+    VolumeTag first;
+
+    if (!ReadVolumeTag(pacPath, first) || first.Volume != 0) return paths;
+
+    for (uint32_t volume = 1; volume < first.VolumeCount; volume++)
+    {
+        auto path = GetVolumePath(pacPath, volume);
+
+        VolumeTag tag;
+
+        if (!ReadVolumeTag(path, tag) || tag.PackageId != first.PackageId || tag.Volume != volume || tag.VolumeCount != first.VolumeCount)
+        {
+            printf("WARNING: Volume '%s' is missing or belongs to another package.\n", path.c_str());
+            break;
+        }
+
+        paths.emplace_back(std::move(path));
+    }
+
+    return paths;
+}